@@ -0,0 +1,84 @@
+#include "arena.h"
+#include <cstdlib>
+#include <cstdint>
+
+static thread_local Arena* current_arena = nullptr;
+
+// Blocks stop doubling here; larger requests get a block of their own
+static const size_t MAX_BLOCK_BYTES = 4 << 20;
+
+Arena::Arena(size_t first_block_bytes)
+    : cursor(nullptr), limit(nullptr), first_block(first_block_bytes > 0 ? first_block_bytes : 4096),
+      next_block(first_block), used(0), reserved(0) {
+}
+
+Arena::~Arena() {
+    release();
+}
+
+Arena* Arena::current() {
+    return current_arena;
+}
+
+char* Arena::newBlock(size_t bytes) {
+    char* block = static_cast<char*>(std::malloc(bytes));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    blocks.push_back(block);
+    reserved += bytes;
+    return block;
+}
+
+void* Arena::allocate(size_t bytes, size_t alignment) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+    uintptr_t at = ((uintptr_t)cursor + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (cursor && at + bytes <= (uintptr_t)limit) {
+        cursor = (char*)(at + bytes);
+        used += bytes;
+        return (void*)at;
+    }
+
+    // Oversized requests get a dedicated block and leave the current one
+    // open for the small allocations that follow
+    size_t padded = bytes + alignment;
+    if (padded > next_block / 2 && padded > MAX_BLOCK_BYTES / 4) {
+        char* block = newBlock(padded);
+        used += bytes;
+        return (void*)(((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    }
+    while (next_block < padded) {
+        next_block *= 2;
+    }
+    char* block = newBlock(next_block);
+    limit = block + next_block;
+    if (next_block < MAX_BLOCK_BYTES) {
+        next_block *= 2;
+    }
+    at = ((uintptr_t)block + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    cursor = (char*)(at + bytes);
+    used += bytes;
+    return (void*)at;
+}
+
+void Arena::release() {
+    for (char* block : blocks) {
+        std::free(block);
+    }
+    blocks.clear();
+    cursor = nullptr;
+    limit = nullptr;
+    next_block = first_block;
+    used = 0;
+    reserved = 0;
+}
+
+ArenaScope::ArenaScope(Arena& arena) : previous(current_arena) {
+    current_arena = &arena;
+}
+
+ArenaScope::~ArenaScope() {
+    current_arena = previous;
+}
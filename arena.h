@@ -0,0 +1,106 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+#include <cstddef>
+#include <new>
+
+// Monotonic bump allocator for the objects of one compilation. Blocks grow
+// geometrically; freeing a single allocation is a no-op and everything is
+// returned at once by release() or the destructor. Not thread-safe: an arena
+// (and every container built in it) belongs to one thread at a time.
+class Arena {
+public:
+    explicit Arena(size_t first_block_bytes = 64 * 1024);
+    ~Arena();
+
+    void* allocate(size_t bytes, size_t alignment);
+    // Free every block; containers built in the arena must be gone
+    void release();
+
+    size_t bytesUsed() const { return used; }          // Handed out so far
+    size_t bytesReserved() const { return reserved; }  // Held in blocks
+
+    // Arena of the innermost ArenaScope on this thread, or nullptr
+    static Arena* current();
+
+private:
+    std::vector<char*> blocks;
+    char* cursor;
+    char* limit;
+    size_t first_block;
+    size_t next_block;
+    size_t used;
+    size_t reserved;
+
+    char* newBlock(size_t bytes);
+
+    Arena(const Arena&);
+    Arena& operator=(const Arena&);
+
+    friend class ArenaScope;
+};
+
+// Makes an arena current on this thread for its lifetime. Containers using
+// ArenaAllocator that are created inside the scope allocate from it, so the
+// arena must outlive them.
+class ArenaScope {
+public:
+    explicit ArenaScope(Arena& arena);
+    ~ArenaScope();
+
+private:
+    Arena* previous;
+
+    ArenaScope(const ArenaScope&);
+    ArenaScope& operator=(const ArenaScope&);
+};
+
+// Standard allocator over the arena that was current when it (or the
+// container holding it) was created, falling back to the heap outside any
+// ArenaScope. Copies of a container follow the scope they are made in.
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    template <typename U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    Arena* arena;
+
+    ArenaAllocator() : arena(Arena::current()) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if (arena) {
+            return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* ptr, size_t) {
+        if (!arena) {
+            ::operator delete(ptr);
+        }
+    }
+
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+// Mutable adjacency of the model classes: one small node per vertex and per
+// link, which is what the arena is for
+typedef std::set<int, std::less<int>, ArenaAllocator<int>> NeighborSet;
+typedef std::map<int, NeighborSet, std::less<int>,
+                 ArenaAllocator<std::pair<const int, NeighborSet>>> AdjacencyMap;
+
+#endif // ARENA_H
@@ -0,0 +1,221 @@
+#include "batch.h"
+#include "arena.h"
+#include "graph.h"
+#include "mrf.h"
+#include "qpu_circuit.h"
+#include "circuit_optimizer.h"
+#include "model_parser.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <unordered_map>
+#include <new>
+#include <exception>
+#include <climits>
+#include <cstdlib>
+
+BatchJob::BatchJob() : line(0) {
+}
+
+BatchResult::BatchResult() : ok(false), nodes(0), cliques(0), gates(0) {
+}
+
+bool readBatchManifest(const std::string& path, std::vector<BatchJob>& jobs) {
+    std::ifstream manifest(path);
+    if (!manifest.is_open()) {
+        std::cerr << "Error: Could not open batch manifest " << path << "\n";
+        return false;
+    }
+
+    jobs.clear();
+    std::string text;
+    size_t line = 0;
+    while (std::getline(manifest, text)) {
+        line++;
+        size_t comment = text.find('#');
+        if (comment != std::string::npos) {
+            text.erase(comment);
+        }
+        std::istringstream fields(text);
+        BatchJob job;
+        job.line = line;
+        std::string extra;
+        if (!(fields >> job.input_file)) {
+            continue;
+        }
+        fields >> job.output_file;
+        if (fields >> extra) {
+            std::cerr << "Error: " << path << ":" << line
+                      << ": expected \"input_file [output_file]\"\n";
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+std::string batchOutputName(const BatchJob& job, Framework fw, bool several) {
+    if (!several && !job.output_file.empty()) {
+        return job.output_file;
+    }
+    std::string base = job.output_file.empty() ? job.input_file : job.output_file;
+    size_t slash = base.find_last_of('/');
+    size_t dot = base.find_last_of('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        base.erase(dot);
+    }
+    if (several) {
+        base += "_" + frameworkToString(fw);
+    }
+    std::unique_ptr<FrameworkExporter> exporter(createExporter(fw));
+    return base + "." + exporter->getFileExtension();
+}
+
+// path made absolute with symlinks resolved, so different spellings of one
+// file compare equal. A file that does not exist yet is resolved through
+// its directory; if that fails too, path is returned as written.
+static std::string canonicalPath(const std::string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)) {
+        return resolved;
+    }
+    size_t slash = path.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    std::string base = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (!base.empty() && realpath(dir.c_str(), resolved)) {
+        std::string canonical = resolved;
+        return (canonical == "/" ? "" : canonical) + "/" + base;
+    }
+    return path;
+}
+
+// The single-file pipeline for one job, with diagnostics collected instead
+// of printed. The model and circuit live in the job's own arena.
+static void compileJob(const BatchJob& job, const std::vector<Framework>& frameworks, bool optimize,
+                       const std::vector<std::string>& outputs, BatchResult& result) {
+    Arena arena;
+    ArenaScope arena_scope(arena);
+
+    MappedFile file;
+    if (!file.open(job.input_file)) {
+        result.diagnostics.push_back("Error: Could not open " + job.input_file);
+        return;
+    }
+    GraphicalModel gm;
+    ModelParser parser;
+    // Jobs are the unit of parallelism; a job's parse stays on its thread
+    parser.setThreads(1);
+    parser.parse(file.data(), file.data() + file.size(), gm);
+    file.close();
+    for (const ParseError& err : parser.getErrors()) {
+        result.diagnostics.push_back("Warning: " + job.input_file + ":" + err.toString());
+    }
+    gm.freezeAdjacency();
+
+    MRF mrf = convertToMRF(gm);
+    QPUCircuit circuit = convertMRFToQPU(mrf);
+    if (optimize) {
+        optimizeCircuit(circuit);
+    }
+    result.nodes = gm.nodes.size();
+    result.cliques = mrf.cliques.size();
+    result.gates = circuit.gates.size();
+
+    result.ok = true;
+    for (size_t f = 0; f < frameworks.size(); f++) {
+        std::unique_ptr<FrameworkExporter> exporter(createExporter(frameworks[f]));
+        if (exporter->exportToFile(circuit, "mrf_circuit", outputs[f])) {
+            result.outputs.push_back(outputs[f]);
+        } else {
+            result.diagnostics.push_back("Error: Could not write to " + outputs[f]);
+            result.ok = false;
+        }
+    }
+}
+
+std::vector<BatchResult> runBatch(const std::vector<BatchJob>& jobs,
+                                  const std::vector<Framework>& frameworks, bool optimize,
+                                  size_t num_threads) {
+    std::vector<BatchResult> results(jobs.size());
+
+    // Output names are fixed up front, so a clash goes to the later job in
+    // manifest order whatever the scheduling
+    bool several = frameworks.size() > 1;
+    std::vector<std::vector<std::string>> outputs(jobs.size());
+    std::vector<char> runnable(jobs.size(), 1);
+    std::unordered_map<std::string, size_t> writer;  // Canonical output -> manifest line
+    for (size_t j = 0; j < jobs.size(); j++) {
+        std::string input = canonicalPath(jobs[j].input_file);
+        for (Framework fw : frameworks) {
+            std::string name = batchOutputName(jobs[j], fw, several);
+            std::string canonical = canonicalPath(name);
+            if (canonical == input) {
+                results[j].diagnostics.push_back("Error: output " + name + " would overwrite the input");
+                runnable[j] = 0;
+            } else if (!writer.emplace(canonical, jobs[j].line).second) {
+                results[j].diagnostics.push_back("Error: output " + name + " is also written by line " +
+                                                 std::to_string(writer[canonical]));
+                runnable[j] = 0;
+            }
+            outputs[j].push_back(name);
+        }
+    }
+
+    ThreadPool pool(num_threads);
+    pool.parallelFor(jobs.size(), [&](size_t j) {
+        if (!runnable[j]) {
+            return;
+        }
+        // A job that throws fails on its own instead of taking the pool down
+        try {
+            compileJob(jobs[j], frameworks, optimize, outputs[j], results[j]);
+        } catch (const std::bad_alloc&) {
+            results[j].ok = false;
+            results[j].diagnostics.push_back("Error: out of memory compiling " + jobs[j].input_file);
+        } catch (const std::exception& e) {
+            results[j].ok = false;
+            results[j].diagnostics.push_back("Error: " + jobs[j].input_file + ": " + e.what());
+        } catch (...) {
+            results[j].ok = false;
+            results[j].diagnostics.push_back("Error: unexpected failure compiling " + jobs[j].input_file);
+        }
+    });
+    return results;
+}
+
+size_t printBatchReport(const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results) {
+    size_t failed = 0;
+    size_t warned = 0;
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const BatchResult& result = results[j];
+        std::cout << "[" << (j + 1) << "/" << jobs.size() << "] " << jobs[j].input_file;
+        if (result.ok) {
+            std::cout << ": " << result.nodes << " nodes, " << result.cliques << " cliques, "
+                      << result.gates << " gates ->";
+            for (const auto& output : result.outputs) {
+                std::cout << " " << output;
+            }
+            std::cout << "\n";
+        } else {
+            std::cout << ": FAILED\n";
+            failed++;
+        }
+        if (result.ok && !result.diagnostics.empty()) {
+            warned++;
+        }
+        for (const auto& line : result.diagnostics) {
+            std::cout << "  " << line << "\n";
+        }
+    }
+    std::cout << "\nBatch: " << (jobs.size() - failed) << " of " << jobs.size() << " models compiled";
+    if (warned > 0) {
+        std::cout << ", " << warned << " with warnings";
+    }
+    if (failed > 0) {
+        std::cout << ", " << failed << " failed";
+    }
+    std::cout << "\n";
+    return failed;
+}
@@ -0,0 +1,60 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "framework_exporters.h"
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// One model of a batch manifest
+class BatchJob {
+public:
+    std::string input_file;
+    std::string output_file;  // Empty: named after the input
+    size_t line;              // Manifest line, for reports
+
+    BatchJob();
+};
+
+// Outcome of one job. Jobs run concurrently, so everything they have to
+// say is collected here and printed in manifest order at the end.
+class BatchResult {
+public:
+    bool ok;
+    size_t nodes;
+    size_t cliques;
+    size_t gates;
+    std::vector<std::string> outputs;      // Files written
+    std::vector<std::string> diagnostics;  // "Warning: ..." / "Error: ..." lines
+
+    BatchResult();
+};
+
+// Read a manifest: one "input_file [output_file]" per line, paths relative
+// to the working directory and free of spaces; blank lines and text after
+// '#' are ignored. Reports on std::cerr and returns false if the manifest
+// cannot be read or has a line with more than two fields.
+bool readBatchManifest(const std::string& path, std::vector<BatchJob>& jobs);
+
+// File that job writes for fw. A single framework goes to the manifest's
+// output name if it has one; otherwise the input (or output) name gets the
+// exporter's extension, with the framework name appended when several
+// frameworks are exported.
+std::string batchOutputName(const BatchJob& job, Framework fw, bool several);
+
+// Compile every job (parse, MRF, circuit, optimizeCircuit if optimize,
+// export) on num_threads threads (0: all cores). Each job is independent,
+// runs in its own arena and writes only its own files; jobs that would
+// write the same file as an earlier one, or their own input, fail instead
+// (paths are compared after resolving them). A job that throws fails with
+// an error diagnostic; the others carry on. Results are in job order, so
+// nothing depends on scheduling.
+std::vector<BatchResult> runBatch(const std::vector<BatchJob>& jobs,
+                                  const std::vector<Framework>& frameworks, bool optimize,
+                                  size_t num_threads);
+
+// Per-job summaries and diagnostics in manifest order, then totals.
+// Returns the number of failed jobs.
+size_t printBatchReport(const std::vector<BatchJob>& jobs, const std::vector<BatchResult>& results);
+
+#endif // BATCH_H
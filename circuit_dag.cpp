@@ -0,0 +1,237 @@
+#include "circuit_dag.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <queue>
+
+DAGNode::DAGNode(const QuantumGate& gate) : gate(gate), layer(0), live(true) {
+    prev[0] = prev[1] = NO_NODE;
+    next[0] = next[1] = NO_NODE;
+}
+
+int DAGNode::wire(int qubit) const {
+    if (gate.target_qubit == qubit) {
+        return 0;
+    }
+    return gate.control_qubit >= 0 && gate.control_qubit == qubit ? 1 : -1;
+}
+
+CircuitDAG::CircuitDAG(int num_qubits)
+    : num_qubits(num_qubits), first(num_qubits > 0 ? num_qubits : 0, NO_NODE),
+      last(num_qubits > 0 ? num_qubits : 0, NO_NODE), live_nodes(0), inserted(false), rewritten(false) {
+}
+
+CircuitDAG::CircuitDAG(const QPUCircuit& circuit) : CircuitDAG(circuit.num_qubits) {
+    nodes.reserve(circuit.gates.size());
+    for (const QuantumGate& gate : circuit.gates) {
+        if (append(gate) == NO_NODE) {
+            rewritten = true;
+        }
+    }
+}
+
+void CircuitDAG::widen(int qubit) {
+    if (qubit >= num_qubits) {
+        num_qubits = qubit + 1;
+        first.resize(num_qubits, NO_NODE);
+        last.resize(num_qubits, NO_NODE);
+    }
+}
+
+// Wires must be distinct, non-negative qubits
+static bool validGate(const QuantumGate& gate) {
+    if (gate.target_qubit >= 0 && gate.control_qubit >= -1 && gate.control_qubit != gate.target_qubit) {
+        return true;
+    }
+    std::cerr << "Error: gate " << gate.toString() << " has an invalid qubit\n";
+    return false;
+}
+
+size_t CircuitDAG::append(const QuantumGate& gate) {
+    if (!validGate(gate)) {
+        return NO_NODE;
+    }
+    size_t id = nodes.size();
+    nodes.push_back(DAGNode(gate));
+    DAGNode& node = nodes.back();
+    for (int w = 0; w < node.wires(); w++) {
+        int q = node.qubit(w);
+        widen(q);
+        size_t p = last[q];
+        node.prev[w] = p;
+        if (p == NO_NODE) {
+            first[q] = id;
+        } else {
+            nodes[p].next[nodes[p].wire(q)] = id;
+            node.layer = std::max(node.layer, nodes[p].layer + 1);
+        }
+        last[q] = id;
+    }
+    live_nodes++;
+    return id;
+}
+
+size_t CircuitDAG::insert(size_t at, const QuantumGate& gate, bool before) {
+    if (!validGate(gate)) {
+        return NO_NODE;
+    }
+    DAGNode node(gate);
+    for (int w = 0; w < node.wires(); w++) {
+        if (nodes[at].wire(node.qubit(w)) < 0) {
+            std::cerr << "Error: cannot insert " << gate.toString() << " next to "
+                      << nodes[at].gate.toString() << ": qubit " << node.qubit(w) << " is not shared\n";
+            return NO_NODE;
+        }
+    }
+    size_t id = nodes.size();
+    nodes.push_back(node);
+    for (int w = 0; w < nodes[id].wires(); w++) {
+        int q = nodes[id].qubit(w);
+        int aw = nodes[at].wire(q);
+        size_t p = before ? nodes[at].prev[aw] : at;
+        size_t n = before ? at : nodes[at].next[aw];
+        nodes[id].prev[w] = p;
+        nodes[id].next[w] = n;
+        if (p == NO_NODE) {
+            first[q] = id;
+        } else {
+            nodes[p].next[nodes[p].wire(q)] = id;
+            nodes[id].layer = std::max(nodes[id].layer, nodes[p].layer + 1);
+        }
+        if (n == NO_NODE) {
+            last[q] = id;
+        } else {
+            nodes[n].prev[nodes[n].wire(q)] = id;
+        }
+    }
+    live_nodes++;
+    inserted = true;
+    rewritten = true;
+    return id;
+}
+
+size_t CircuitDAG::insertBefore(size_t node, const QuantumGate& gate) {
+    return insert(node, gate, true);
+}
+
+size_t CircuitDAG::insertAfter(size_t node, const QuantumGate& gate) {
+    return insert(node, gate, false);
+}
+
+void CircuitDAG::remove(size_t id) {
+    DAGNode& node = nodes[id];
+    if (!node.live) {
+        return;
+    }
+    for (int w = 0; w < node.wires(); w++) {
+        int q = node.qubit(w);
+        size_t p = node.prev[w];
+        size_t n = node.next[w];
+        if (p == NO_NODE) {
+            first[q] = n;
+        } else {
+            nodes[p].next[nodes[p].wire(q)] = n;
+        }
+        if (n == NO_NODE) {
+            last[q] = p;
+        } else {
+            nodes[n].prev[nodes[n].wire(q)] = p;
+        }
+    }
+    node.live = false;
+    live_nodes--;
+    rewritten = true;
+}
+
+size_t CircuitDAG::predecessor(size_t node, int qubit) const {
+    int w = nodes[node].wire(qubit);
+    return w < 0 ? NO_NODE : nodes[node].prev[w];
+}
+
+size_t CircuitDAG::successor(size_t node, int qubit) const {
+    int w = nodes[node].wire(qubit);
+    return w < 0 ? NO_NODE : nodes[node].next[w];
+}
+
+size_t CircuitDAG::depth() const {
+    size_t depth = 0;
+    for (int q = 0; q < num_qubits; q++) {
+        if (last[q] != NO_NODE) {
+            depth = std::max(depth, nodes[last[q]].layer + 1);
+        }
+    }
+    return depth;
+}
+
+size_t CircuitDAG::updateLayers() {
+    std::vector<size_t> order;
+    topologicalOrder(order);
+    for (size_t id : order) {
+        DAGNode& node = nodes[id];
+        node.layer = 0;
+        for (int w = 0; w < node.wires(); w++) {
+            if (node.prev[w] != NO_NODE) {
+                node.layer = std::max(node.layer, nodes[node.prev[w]].layer + 1);
+            }
+        }
+    }
+    return depth();
+}
+
+void CircuitDAG::topologicalOrder(std::vector<size_t>& order) const {
+    order.clear();
+    order.reserve(live_nodes);
+    if (!inserted) {
+        for (size_t id = 0; id < nodes.size(); id++) {
+            if (nodes[id].live) {
+                order.push_back(id);
+            }
+        }
+        return;
+    }
+    // Kahn's algorithm, smallest id first, so gates keep their relative
+    // order wherever the wires allow it
+    std::vector<unsigned char> waiting(nodes.size(), 0);
+    std::priority_queue<size_t, std::vector<size_t>, std::greater<size_t>> ready;
+    for (size_t id = 0; id < nodes.size(); id++) {
+        const DAGNode& node = nodes[id];
+        if (!node.live) {
+            continue;
+        }
+        for (int w = 0; w < node.wires(); w++) {
+            waiting[id] += node.prev[w] != NO_NODE;
+        }
+        if (waiting[id] == 0) {
+            ready.push(id);
+        }
+    }
+    while (!ready.empty()) {
+        size_t id = ready.top();
+        ready.pop();
+        order.push_back(id);
+        const DAGNode& node = nodes[id];
+        for (int w = 0; w < node.wires(); w++) {
+            size_t n = node.next[w];
+            if (n != NO_NODE && --waiting[n] == 0) {
+                ready.push(n);
+            }
+        }
+    }
+}
+
+void CircuitDAG::toGates(GateList& gates) const {
+    std::vector<size_t> order;
+    topologicalOrder(order);
+    gates.clear();
+    gates.reserve(order.size());
+    for (size_t id : order) {
+        gates.push_back(nodes[id].gate);
+    }
+}
+
+void CircuitDAG::writeTo(QPUCircuit& circuit) const {
+    toGates(circuit.gates);
+    if (rewritten) {
+        circuit.clique_gate_offsets.clear();
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef CIRCUIT_DAG_H
+#define CIRCUIT_DAG_H
+
+#include "qpu_circuit.h"
+#include <vector>
+#include <cstddef>
+
+// No node: the start or end of a wire, or a failed insertion
+static const size_t NO_NODE = (size_t)-1;
+
+// One gate of a CircuitDAG. Wire 0 is the gate's target qubit and wire 1 its
+// control; single-qubit gates (control -1) have only wire 0.
+class DAGNode {
+public:
+    QuantumGate gate;
+    size_t prev[2];  // Previous live gate on each wire, NO_NODE at the start
+    size_t next[2];  // Next live gate on each wire, NO_NODE at the end
+    size_t layer;    // ASAP layer, from 0
+    bool live;       // False once removed
+
+    DAGNode(const QuantumGate& gate);
+    int wires() const { return gate.control_qubit >= 0 ? 2 : 1; }
+    int qubit(int wire) const { return wire == 0 ? gate.target_qubit : gate.control_qubit; }
+    // Wire of this node on qubit, -1 if the gate does not touch it
+    int wire(int qubit) const;
+};
+
+// Dependency graph of a gate list: every qubit is a doubly linked list of
+// the gates on it, so a gate's neighbours on each qubit, and removing or
+// inserting a gate, are constant time. Node ids index nodes and are stable;
+// removed nodes stay behind as tombstones.
+//
+// Layers are exact after append (and so after building from a circuit) and
+// after updateLayers. remove and insert leave later layers stale; a pass that
+// needs them again calls updateLayers. The gate type and parameter of a live
+// node may be changed in place, its qubits may not.
+class CircuitDAG {
+public:
+    int num_qubits;
+    std::vector<DAGNode> nodes;
+    std::vector<size_t> first;  // Per qubit, first live gate (NO_NODE: none)
+    std::vector<size_t> last;   // Per qubit, last live gate
+
+    CircuitDAG(int num_qubits = 0);
+    // One pass over circuit.gates; gates on qubits at or above
+    // circuit.num_qubits widen the DAG, invalid gates are left out
+    explicit CircuitDAG(const QPUCircuit& circuit);
+
+    // Add gate at the end of its wires. Gates on a negative qubit, or whose
+    // control is its target, are reported on std::cerr and give NO_NODE.
+    size_t append(const QuantumGate& gate);
+    // Add gate just before (after) node on each of gate's qubits, which must
+    // be valid and all be qubits of node; reports on std::cerr and returns
+    // NO_NODE if not
+    size_t insertBefore(size_t node, const QuantumGate& gate);
+    size_t insertAfter(size_t node, const QuantumGate& gate);
+    // Unlink node from its wires
+    void remove(size_t node);
+
+    // Neighbouring live gates of node on qubit (NO_NODE at a wire's end)
+    size_t predecessor(size_t node, int qubit) const;
+    size_t successor(size_t node, int qubit) const;
+
+    size_t size() const { return live_nodes; }
+    // Layers in use (1 + largest layer of a live node)
+    size_t depth() const;
+    // Recompute every layer in topological order; returns depth()
+    size_t updateLayers();
+    // Live node ids in an order that respects every wire. Without inserted
+    // nodes this is id order, i.e. the order the gates were appended in.
+    void topologicalOrder(std::vector<size_t>& order) const;
+    // The live gates in topologicalOrder
+    void toGates(GateList& gates) const;
+    // Replace circuit's gates with the DAG's; clique_gate_offsets is cleared
+    // if anything was removed or inserted
+    void writeTo(QPUCircuit& circuit) const;
+
+private:
+    size_t live_nodes;
+    bool inserted;  // Ids no longer follow wire order
+    bool rewritten;
+
+    void widen(int qubit);
+    size_t insert(size_t node, const QuantumGate& gate, bool before);
+};
+
+#endif // CIRCUIT_DAG_H
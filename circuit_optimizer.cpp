@@ -0,0 +1,119 @@
+#include "circuit_optimizer.h"
+#include "circuit_dag.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+OptimizationStats::OptimizationStats()
+    : gates_before(0), gates_after(0), zero_rotations(0), merged_rotations(0),
+      cancelled_cnots(0), collapsed_rzz(0) {
+}
+
+void OptimizationStats::print() const {
+    std::cout << "Circuit optimization: " << gates_before << " -> " << gates_after << " gates\n";
+    std::cout << "  Zero-angle rotations dropped: " << zero_rotations << "\n";
+    std::cout << "  Rotations merged: " << merged_rotations << "\n";
+    std::cout << "  CNOT pairs cancelled: " << cancelled_cnots << "\n";
+    std::cout << "  CNOT-RZ-CNOT collapsed to RZZ: " << collapsed_rzz << "\n";
+}
+
+static bool isTwoQubit(GateType type) {
+    return type == GateType::CNOT || type == GateType::CPHASE || type == GateType::RZZ;
+}
+
+static bool isRotation(GateType type) {
+    return type == GateType::RX || type == GateType::RY || type == GateType::RZ ||
+           type == GateType::CPHASE || type == GateType::RZZ;
+}
+
+// The optimized gates so far as a DAG, built by appending; its wires make
+// "adjacent on these qubits" a constant-time question, and removed gates are
+// unlinked from them.
+class PeepholeWindow {
+public:
+    CircuitDAG dag;
+    OptimizationStats& stats;
+
+    PeepholeWindow(int width, size_t capacity, OptimizationStats& stats)
+        : dag(width), stats(stats) {
+        dag.nodes.reserve(capacity);
+    }
+
+    void add(const QuantumGate& gate) {
+        int t = gate.target_qubit;
+        int c = gate.control_qubit;
+        if (t < 0 || c < -1 || c == t) {
+            dag.append(gate);  // Rejected and reported
+            return;
+        }
+        if (isRotation(gate.type) && std::abs(gate.parameter) < ZERO_ANGLE) {
+            stats.zero_rotations++;
+            return;
+        }
+        if (isRotation(gate.type)) {
+            size_t i = dag.last[t];
+            bool same = i != NO_NODE && dag.nodes[i].gate.type == gate.type &&
+                        (!isTwoQubit(gate.type) || (dag.last[c] == i && samePair(dag.nodes[i].gate, gate)));
+            if (same) {
+                stats.merged_rotations++;
+                dag.nodes[i].gate.parameter += gate.parameter;
+                if (std::abs(dag.nodes[i].gate.parameter) < ZERO_ANGLE) {
+                    dag.remove(i);
+                }
+                return;
+            }
+        }
+        if (gate.type == GateType::CNOT && dag.last[t] != NO_NODE && dag.last[c] != NO_NODE) {
+            size_t j = dag.last[t];
+            size_t i = j;
+            if (dag.nodes[j].gate.type == GateType::RZ) {
+                i = dag.predecessor(j, t);
+            }
+            bool match = i != NO_NODE && dag.last[c] == i && dag.nodes[i].gate.type == GateType::CNOT &&
+                         dag.nodes[i].gate.control_qubit == c && dag.nodes[i].gate.target_qubit == t;
+            if (match && i == j) {
+                stats.cancelled_cnots++;
+                dag.remove(i);
+                return;
+            }
+            if (match) {
+                // Nothing after the first CNOT touches c, so the RZZ can take
+                // the place of the second and may merge with what precedes it
+                stats.collapsed_rzz++;
+                double angle = dag.nodes[j].gate.parameter;
+                dag.remove(j);
+                dag.remove(i);
+                add(QuantumGate(GateType::RZZ, t, c, angle));
+                return;
+            }
+        }
+        dag.append(gate);
+    }
+
+private:
+    static bool samePair(const QuantumGate& a, const QuantumGate& b) {
+        // RZZ and CPHASE are symmetric in their qubits
+        return (a.target_qubit == b.target_qubit && a.control_qubit == b.control_qubit) ||
+               (a.target_qubit == b.control_qubit && a.control_qubit == b.target_qubit);
+    }
+};
+
+OptimizationStats optimizeCircuit(QPUCircuit& circuit) {
+    OptimizationStats stats;
+    stats.gates_before = circuit.gates.size();
+
+    int width = circuit.num_qubits;
+    for (const QuantumGate& gate : circuit.gates) {
+        width = std::max(width, std::max(gate.target_qubit, gate.control_qubit) + 1);
+    }
+    PeepholeWindow window(width, circuit.gates.size(), stats);
+    for (const QuantumGate& gate : circuit.gates) {
+        window.add(gate);
+    }
+
+    window.dag.toGates(circuit.gates);
+    circuit.clique_gate_offsets.clear();
+    stats.gates_after = circuit.gates.size();
+    return stats;
+}
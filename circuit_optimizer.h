@@ -0,0 +1,36 @@
+#ifndef CIRCUIT_OPTIMIZER_H
+#define CIRCUIT_OPTIMIZER_H
+
+#include "qpu_circuit.h"
+#include <cstddef>
+
+// Angles this close to zero count as no rotation
+static const double ZERO_ANGLE = 1e-12;
+
+// What optimizeCircuit changed
+class OptimizationStats {
+public:
+    size_t gates_before;
+    size_t gates_after;
+    size_t zero_rotations;    // Rotations by a zero angle dropped
+    size_t merged_rotations;  // Rotations folded into the previous one on the same axis
+    size_t cancelled_cnots;   // Adjacent identical CNOT pairs removed
+    size_t collapsed_rzz;     // CNOT-RZ-CNOT triples replaced by one RZZ
+
+    OptimizationStats();
+    void print() const;
+};
+
+// Peephole pass over circuit.gates. Gates are adjacent when no gate in
+// between touches their qubits. In one pass:
+//   - RX/RY/RZ/RZZ/CPHASE rotations by a zero angle are dropped
+//   - a rotation adjacent to one of the same kind on the same qubits is
+//     merged into it (and both vanish if the angles cancel)
+//   - adjacent identical CNOTs cancel
+//   - CNOT(c,t) RZ(t) CNOT(c,t) becomes RZZ(c,t), which exporters without a
+//     native ZZ rotation write out as the triple again
+// Removals expose new neighbours, so cascades are followed. The result is
+// the same unitary. Gates move, so clique_gate_offsets is cleared.
+OptimizationStats optimizeCircuit(QPUCircuit& circuit);
+
+#endif // CIRCUIT_OPTIMIZER_H
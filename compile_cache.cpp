@@ -0,0 +1,497 @@
+#include "compile_cache.h"
+#include "model_binary.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+// Bump whenever the compiler's output for the same model changes, so old
+// entries stop matching
+static const char CACHE_FORMAT_TAG[] = "mrf-compiler cache 1";
+
+// StableHash implementation
+static const uint64_t HASH_PRIME_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t HASH_PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t HASH_PRIME_3 = 0x165667B19E3779F9ULL;
+
+static inline uint64_t rotateLeft(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Final avalanche (splitmix64)
+static inline uint64_t finalizeLane(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+StableHash::StableHash()
+    : lane_a(HASH_PRIME_1 + HASH_PRIME_2), lane_b(HASH_PRIME_3), pending(0), pending_bytes(0),
+      total_bytes(0) {
+}
+
+void StableHash::mixWord(uint64_t word) {
+    lane_a = rotateLeft(lane_a + word * HASH_PRIME_2, 31) * HASH_PRIME_1;
+    lane_b = rotateLeft(lane_b ^ (word * HASH_PRIME_1), 27) * HASH_PRIME_2 + HASH_PRIME_3;
+}
+
+void StableHash::addBytes(const void* data, size_t bytes) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    total_bytes += bytes;
+    // Top up a partial word first, then take whole words
+    while (bytes > 0 && pending_bytes > 0) {
+        pending |= (uint64_t)*p++ << (8 * pending_bytes);
+        bytes--;
+        if (++pending_bytes == 8) {
+            mixWord(pending);
+            pending = 0;
+            pending_bytes = 0;
+        }
+    }
+    while (bytes >= 8) {
+        uint64_t word;
+        std::memcpy(&word, p, 8);
+        mixWord(word);
+        p += 8;
+        bytes -= 8;
+    }
+    while (bytes > 0) {
+        pending |= (uint64_t)*p++ << (8 * pending_bytes);
+        pending_bytes++;
+        bytes--;
+    }
+}
+
+void StableHash::add(double value) {
+    if (value == 0.0) {
+        value = 0.0;
+    }
+    addBytes(&value, sizeof(value));
+}
+
+void StableHash::add(const std::string& value) {
+    add((uint64_t)value.size());
+    addBytes(value.data(), value.size());
+}
+
+void StableHash::add(const double* values, size_t count) {
+    add((uint64_t)count);
+    for (size_t i = 0; i < count; i++) {
+        add(values[i]);
+    }
+}
+
+std::string StableHash::hex() const {
+    uint64_t a = lane_a;
+    uint64_t b = lane_b;
+    if (pending_bytes > 0) {
+        a = rotateLeft(a + pending * HASH_PRIME_2, 31) * HASH_PRIME_1;
+        b = rotateLeft(b ^ (pending * HASH_PRIME_1), 27) * HASH_PRIME_2 + HASH_PRIME_3;
+    }
+    a = finalizeLane(a ^ total_bytes);
+    b = finalizeLane(b + a);
+    char buffer[33];
+    std::snprintf(buffer, sizeof(buffer), "%016llx%016llx", (unsigned long long)a,
+                  (unsigned long long)b);
+    return buffer;
+}
+
+static void hashNode(StableHash& hash, const Node& node) {
+    hash.add((int32_t)node.id);
+    hash.add(node.name);
+    hash.add((int32_t)node.num_states);
+    hash.add(node.potential.data(), node.potential.size());
+    hash.add((int32_t)(node.has_cpt ? 1 : 0));
+    const DenseCPT& cpt = node.cpt;
+    hash.add((int32_t)cpt.num_states);
+    hash.add((uint64_t)cpt.parent_cards.size());
+    for (int card : cpt.parent_cards) {
+        hash.add((int32_t)card);
+    }
+    hash.add(cpt.probs.data(), cpt.probs.size());
+    for (size_t r = 0; r < cpt.numRows(); r++) {
+        hash.add((int32_t)(cpt.row_set[r] ? 1 : 0));
+    }
+}
+
+static void hashModelInto(StableHash& hash, const GraphicalModel& gm) {
+    hash.add((int32_t)gm.type);
+    hash.add((uint64_t)gm.nodes.size());
+    for (const auto& node : gm.nodes) {
+        hashNode(hash, node);
+    }
+    hash.add((uint64_t)gm.edges.size());
+    for (const auto& edge : gm.edges) {
+        hash.add((int32_t)edge.from);
+        hash.add((int32_t)edge.to);
+        hash.add((int32_t)(edge.directed ? 1 : 0));
+        hash.add((uint64_t)edge.potential.size());
+        for (const auto& row : edge.potential) {
+            hash.add(row.data(), row.size());
+        }
+    }
+}
+
+std::string hashModel(const GraphicalModel& gm) {
+    StableHash hash;
+    hashModelInto(hash, gm);
+    return hash.hex();
+}
+
+// Circuit files: magic, qubit count, gate count, measured count, clique
+// offset count, gates, measured qubits, clique gate offsets
+static const char CIRCUIT_MAGIC[8] = {'M', 'R', 'F', 'Q', 'P', 'U', 0, 2};
+
+struct CircuitGateRecord {
+    int32_t type;
+    int32_t target;
+    int32_t control;
+    int32_t reserved;
+    double parameter;
+};
+
+// CompileCache implementation
+CompileCache::CompileCache(const std::string& directory, uint64_t max_bytes)
+    : hits(0), misses(0), stores(0), evictions(0), directory(directory), max_bytes(max_bytes),
+      enabled(false) {
+    if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Warning: could not create cache directory " << directory
+                  << ", caching disabled\n";
+        return;
+    }
+    struct stat info;
+    enabled = stat(directory.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+    if (!enabled) {
+        std::cerr << "Warning: " << directory << " is not a directory, caching disabled\n";
+    }
+}
+
+std::string CompileCache::modelKey(const GraphicalModel& gm) const {
+    StableHash hash;
+    hash.add(std::string(CACHE_FORMAT_TAG));
+    hashModelInto(hash, gm);
+    return hash.hex();
+}
+
+std::string CompileCache::entryPath(const std::string& key, const std::string& suffix) const {
+    return directory + "/" + key + "." + suffix;
+}
+
+std::string CompileCache::tempPath(const std::string& path) const {
+    return path + ".tmp" + std::to_string((long)getpid());
+}
+
+bool CompileCache::commit(const std::string& temp, const std::string& path) {
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        std::cerr << "Warning: could not store cache entry " << path << "\n";
+        return false;
+    }
+    stores++;
+    return true;
+}
+
+// A hit refreshes the entry's modification time, which is its LRU position
+void CompileCache::recordLookup(const std::string& path, bool hit) {
+    if (hit) {
+        hits++;
+        utimes(path.c_str(), nullptr);
+    } else {
+        misses++;
+    }
+}
+
+bool CompileCache::loadMRF(const std::string& key, MRF& mrf) {
+    if (!enabled) {
+        return false;
+    }
+    std::string path = entryPath(key, "mrfb");
+    bool hit = false;
+    if (access(path.c_str(), R_OK) == 0) {
+        BinaryModelFile binary;
+        hit = binary.open(path) && binary.loadMRF(mrf);
+    }
+    recordLookup(path, hit);
+    return hit;
+}
+
+bool CompileCache::loadModel(const std::string& key, GraphicalModel& gm, MRF& mrf) {
+    if (!enabled) {
+        return false;
+    }
+    std::string path = entryPath(key, "mrfb");
+    bool hit = false;
+    if (access(path.c_str(), R_OK) == 0) {
+        BinaryModelFile binary;
+        hit = binary.open(path) && binary.loadGraphicalModel(gm) && binary.loadMRF(mrf);
+    }
+    recordLookup(path, hit);
+    return hit;
+}
+
+void CompileCache::storeMRF(const std::string& key, const GraphicalModel& gm, const MRF& mrf) {
+    if (!enabled) {
+        return;
+    }
+    std::string path = entryPath(key, "mrfb");
+    std::string temp = tempPath(path);
+    if (saveBinaryModel(temp, gm, &mrf)) {
+        commit(temp, path);
+    } else {
+        std::remove(temp.c_str());
+    }
+}
+
+bool CompileCache::loadCircuit(const std::string& key, QPUCircuit& circuit) {
+    if (!enabled) {
+        return false;
+    }
+    std::string path = entryPath(key, "circuit");
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    // Counts come from the file: each must fit in the bytes left before
+    // anything is allocated for it
+    uint64_t remaining = in ? (uint64_t)in.tellg() : 0;
+    in.seekg(0);
+    bool hit = false;
+    char magic[8];
+    int32_t num_qubits = 0;
+    uint64_t num_gates = 0;
+    uint64_t num_measured = 0;
+    uint64_t num_offsets = 0;
+    const uint64_t header = sizeof(magic) + sizeof(num_qubits) + 3 * sizeof(uint64_t);
+    if (remaining >= header && in.read(magic, sizeof(magic)) &&
+        std::memcmp(magic, CIRCUIT_MAGIC, sizeof(magic)) == 0 &&
+        in.read(reinterpret_cast<char*>(&num_qubits), sizeof(num_qubits)) &&
+        in.read(reinterpret_cast<char*>(&num_gates), sizeof(num_gates)) &&
+        in.read(reinterpret_cast<char*>(&num_measured), sizeof(num_measured)) &&
+        in.read(reinterpret_cast<char*>(&num_offsets), sizeof(num_offsets)) && num_qubits >= 0) {
+        remaining -= header;
+        bool sizes_ok = num_gates <= remaining / sizeof(CircuitGateRecord);
+        if (sizes_ok) {
+            remaining -= num_gates * sizeof(CircuitGateRecord);
+            sizes_ok = num_measured <= remaining / sizeof(int32_t);
+        }
+        if (sizes_ok) {
+            remaining -= num_measured * sizeof(int32_t);
+            sizes_ok = num_offsets <= remaining / sizeof(uint64_t);
+        }
+        std::vector<CircuitGateRecord> gates(sizes_ok ? num_gates : 0);
+        std::vector<int32_t> measured(sizes_ok ? num_measured : 0);
+        std::vector<uint64_t> offsets(sizes_ok ? num_offsets : 0);
+        if (sizes_ok &&
+            in.read(reinterpret_cast<char*>(gates.data()), num_gates * sizeof(CircuitGateRecord)) &&
+            in.read(reinterpret_cast<char*>(measured.data()), num_measured * sizeof(int32_t)) &&
+            in.read(reinterpret_cast<char*>(offsets.data()), num_offsets * sizeof(uint64_t))) {
+            QPUCircuit loaded(num_qubits);
+            loaded.gates.reserve(num_gates);
+            hit = true;
+            for (const auto& gate : gates) {
+                bool valid = gate.type >= 0 && gate.type <= (int32_t)GateType::RZZ &&
+                             gate.target >= 0 && gate.target < num_qubits &&
+                             (gate.control == -1 ||
+                              (gate.control >= 0 && gate.control < num_qubits && gate.control != gate.target));
+                if (!valid) {
+                    hit = false;
+                    break;
+                }
+                loaded.gates.emplace_back((GateType)gate.type, gate.target, gate.control, gate.parameter);
+            }
+            for (int32_t qubit : measured) {
+                hit = hit && qubit >= 0 && qubit < num_qubits;
+            }
+            for (uint64_t offset : offsets) {
+                hit = hit && offset <= num_gates;
+            }
+            if (hit) {
+                loaded.measurement_qubits.assign(measured.begin(), measured.end());
+                loaded.clique_gate_offsets.assign(offsets.begin(), offsets.end());
+                circuit = std::move(loaded);
+            }
+        }
+    }
+    recordLookup(path, hit);
+    return hit;
+}
+
+void CompileCache::storeCircuit(const std::string& key, const QPUCircuit& circuit) {
+    if (!enabled) {
+        return;
+    }
+    std::string path = entryPath(key, "circuit");
+    std::string temp = tempPath(path);
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    int32_t num_qubits = circuit.num_qubits;
+    uint64_t num_gates = circuit.gates.size();
+    uint64_t num_measured = circuit.measurement_qubits.size();
+    uint64_t num_offsets = circuit.clique_gate_offsets.size();
+    out.write(CIRCUIT_MAGIC, sizeof(CIRCUIT_MAGIC));
+    out.write(reinterpret_cast<const char*>(&num_qubits), sizeof(num_qubits));
+    out.write(reinterpret_cast<const char*>(&num_gates), sizeof(num_gates));
+    out.write(reinterpret_cast<const char*>(&num_measured), sizeof(num_measured));
+    out.write(reinterpret_cast<const char*>(&num_offsets), sizeof(num_offsets));
+    for (const auto& gate : circuit.gates) {
+        CircuitGateRecord record = {(int32_t)gate.type, gate.target_qubit, gate.control_qubit, 0,
+                                    gate.parameter};
+        out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+    }
+    for (int qubit : circuit.measurement_qubits) {
+        int32_t value = qubit;
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    for (size_t offset : circuit.clique_gate_offsets) {
+        uint64_t value = offset;
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    out.close();
+    if (out) {
+        commit(temp, path);
+    } else {
+        std::remove(temp.c_str());
+    }
+}
+
+bool CompileCache::loadText(const std::string& key, const std::string& tag, std::string& text) {
+    if (!enabled) {
+        return false;
+    }
+    std::string path = entryPath(key, tag);
+    std::ifstream in(path, std::ios::binary);
+    bool hit = false;
+    if (in.is_open()) {
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        text = contents.str();
+        hit = true;
+    }
+    recordLookup(path, hit);
+    return hit;
+}
+
+void CompileCache::storeText(const std::string& key, const std::string& tag, const std::string& text) {
+    if (!enabled) {
+        return;
+    }
+    std::string path = entryPath(key, tag);
+    std::string temp = tempPath(path);
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out << text;
+    out.close();
+    if (out) {
+        commit(temp, path);
+    } else {
+        std::remove(temp.c_str());
+    }
+}
+
+std::string CompileCache::sourcePath(const std::string& source) const {
+    char* resolved = realpath(source.c_str(), nullptr);
+    StableHash hash;
+    hash.add(std::string(resolved ? resolved : source.c_str()));
+    free(resolved);
+    return entryPath(hash.hex(), "source");
+}
+
+bool CompileCache::previousKey(const std::string& source, std::string& key) {
+    if (!enabled) {
+        return false;
+    }
+    std::string path = sourcePath(source);
+    std::ifstream in(path);
+    if (!(in >> key) || key.size() != 32) {
+        return false;
+    }
+    utimes(path.c_str(), nullptr);
+    return true;
+}
+
+void CompileCache::recordSource(const std::string& source, const std::string& key) {
+    if (!enabled) {
+        return;
+    }
+    std::string path = sourcePath(source);
+    std::string temp = tempPath(path);
+    std::ofstream out(temp, std::ios::trunc);
+    out << key << "\n";
+    out.close();
+    if (out && std::rename(temp.c_str(), path.c_str()) == 0) {
+        return;
+    }
+    std::remove(temp.c_str());
+}
+
+// Cache file considered for eviction
+class CacheEntry {
+public:
+    std::string path;
+    uint64_t bytes;
+    struct timespec used;
+};
+
+void CompileCache::evict() {
+    if (!enabled) {
+        return;
+    }
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<CacheEntry> entries;
+    uint64_t total = 0;
+    while (struct dirent* item = readdir(dir)) {
+        std::string name = item->d_name;
+        // Entry names start with the 32-digit key; skip temporaries in flight
+        if (name.size() < 34 || name[32] != '.' || name.find(".tmp") != std::string::npos) {
+            continue;
+        }
+        CacheEntry entry;
+        entry.path = directory + "/" + name;
+        struct stat info;
+        if (stat(entry.path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        entry.bytes = info.st_size;
+        entry.used = info.st_mtim;
+        total += entry.bytes;
+        entries.push_back(entry);
+    }
+    closedir(dir);
+    if (total <= max_bytes) {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const CacheEntry& a, const CacheEntry& b) {
+        return a.used.tv_sec != b.used.tv_sec ? a.used.tv_sec < b.used.tv_sec
+                                              : a.used.tv_nsec < b.used.tv_nsec;
+    });
+    for (const auto& entry : entries) {
+        if (total <= max_bytes) {
+            break;
+        }
+        if (std::remove(entry.path.c_str()) == 0) {
+            total -= entry.bytes;
+            evictions++;
+        }
+    }
+}
+
+void CompileCache::printStats() const {
+    size_t lookups = hits + misses;
+    std::cout << "Compile cache (" << directory << "): " << hits << " hits, " << misses
+              << " misses";
+    if (lookups > 0) {
+        std::cout << " (" << (100 * hits / lookups) << "% hit rate)";
+    }
+    std::cout << ", " << stores << " stored, " << evictions << " evicted\n";
+}
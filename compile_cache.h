@@ -0,0 +1,98 @@
+#ifndef COMPILE_CACHE_H
+#define COMPILE_CACHE_H
+
+#include "graph.h"
+#include "mrf.h"
+#include "qpu_circuit.h"
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Stable 128-bit content hash (two independent 64-bit lanes). Values are
+// fed in native byte order, so keys are stable across runs and builds on
+// the same platform.
+class StableHash {
+public:
+    StableHash();
+
+    void addBytes(const void* data, size_t bytes);
+    void add(int32_t value) { addBytes(&value, sizeof(value)); }
+    void add(uint64_t value) { addBytes(&value, sizeof(value)); }
+    void add(double value);               // -0.0 hashes like 0.0
+    void add(const std::string& value);   // Length-prefixed
+    void add(const double* values, size_t count);
+
+    std::string hex() const;  // 32 hex digits
+
+private:
+    uint64_t lane_a;
+    uint64_t lane_b;
+    uint64_t pending;     // Bytes not yet forming a full word
+    size_t pending_bytes;
+    uint64_t total_bytes;
+
+    void mixWord(uint64_t word);
+};
+
+// Hash of the parsed model: graph type, nodes and edges in declaration order
+// with their potentials and CPTs. Formatting, comments, how CPT rows were
+// split over lines and whether the model came from text or binary do not
+// change it; anything that changes the compiled output does.
+std::string hashModel(const GraphicalModel& gm);
+
+// On-disk cache of compilation artifacts, keyed by the model hash. Each
+// artifact is one file in the cache directory:
+//
+//   <key>.mrfb             model and compiled MRF (binary model format)
+//   <key>.circuit          QPU circuit
+//   <key>.<option tag>     exported code, tagged by framework and circuit name
+//   <path hash>.source     key last compiled from an input file
+//
+// Files are written under a temporary name and renamed into place, so
+// concurrent compilers sharing a directory never read partial entries.
+// Recency is the file modification time, refreshed on every hit; evict()
+// removes least recently used files until the directory fits max_bytes.
+class CompileCache {
+public:
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+
+    CompileCache(const std::string& directory, uint64_t max_bytes);
+
+    // False if the directory could not be created
+    bool isEnabled() const { return enabled; }
+    std::string modelKey(const GraphicalModel& gm) const;
+
+    bool loadMRF(const std::string& key, MRF& mrf);
+    // Model and MRF of an entry, for diffing a new compilation against it
+    bool loadModel(const std::string& key, GraphicalModel& gm, MRF& mrf);
+    void storeMRF(const std::string& key, const GraphicalModel& gm, const MRF& mrf);
+    bool loadCircuit(const std::string& key, QPUCircuit& circuit);
+    void storeCircuit(const std::string& key, const QPUCircuit& circuit);
+    bool loadText(const std::string& key, const std::string& tag, std::string& text);
+    void storeText(const std::string& key, const std::string& tag, const std::string& text);
+
+    // Key last compiled from a source file, so an edited file can be
+    // recompiled against its previous version
+    bool previousKey(const std::string& source, std::string& key);
+    void recordSource(const std::string& source, const std::string& key);
+
+    // Drop least recently used entries until the cache fits its budget
+    void evict();
+    void printStats() const;
+
+private:
+    std::string directory;
+    uint64_t max_bytes;
+    bool enabled;
+
+    std::string entryPath(const std::string& key, const std::string& suffix) const;
+    std::string sourcePath(const std::string& source) const;
+    std::string tempPath(const std::string& path) const;
+    bool commit(const std::string& temp, const std::string& path);
+    void recordLookup(const std::string& path, bool hit);
+};
+
+#endif // COMPILE_CACHE_H
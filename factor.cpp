@@ -0,0 +1,85 @@
+#include "factor.h"
+#include "factor_ops.h"
+
+// Factor implementation
+Factor::Factor() {
+}
+
+Factor::Factor(const std::vector<int>& vars, const std::vector<int>& cards, double fill)
+    : vars(vars), cards(cards), strides(vars.size(), 1) {
+    size_t size = 1;
+    for (int i = (int)vars.size() - 1; i >= 0; i--) {
+        strides[i] = size;
+        size *= cards[i];
+    }
+    values.assign(size, fill);
+}
+
+size_t Factor::tableSize() const {
+    size_t size = 1;
+    for (int card : cards) {
+        size *= card;
+    }
+    return size;
+}
+
+int Factor::position(int var) const {
+    for (size_t i = 0; i < vars.size(); i++) {
+        if (vars[i] == var) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+size_t Factor::indexOf(const std::vector<int>& states) const {
+    size_t index = 0;
+    for (size_t i = 0; i < strides.size(); i++) {
+        index += states[i] * strides[i];
+    }
+    return index;
+}
+
+std::vector<size_t> Factor::linkedStrides(const Factor& other) const {
+    std::vector<size_t> linked(vars.size(), 0);
+    for (size_t i = 0; i < vars.size(); i++) {
+        int pos = other.position(vars[i]);
+        if (pos >= 0) {
+            linked[i] = other.strides[pos];
+        }
+    }
+    return linked;
+}
+
+bool Factor::covers(const Factor& other) const {
+    for (size_t i = 0; i < other.vars.size(); i++) {
+        int pos = position(other.vars[i]);
+        if (pos < 0 || cards[pos] != other.cards[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Factor::setValues(const std::vector<double>& table) {
+    values.assign(table.begin(), table.end());
+}
+
+// The table algebra itself lives in factor_ops, which picks vector kernels
+// for the running CPU
+bool Factor::multiply(const Factor& other) {
+    return factorProduct(*this, other);
+}
+
+bool Factor::marginalizeInto(Factor& out) const {
+    return factorSumOut(*this, out);
+}
+
+void Factor::normalize() {
+    factorNormalize(*this);
+}
+
+// FactorCursor implementation
+FactorCursor::FactorCursor(const std::vector<int>& cards, const std::vector<size_t>& linked_strides)
+    : cards(cards), strides(linked_strides), current(cards.size(), 0), offset(0) {
+}
@@ -0,0 +1,99 @@
+#ifndef FACTOR_H
+#define FACTOR_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Allocator handing out blocks aligned to `Alignment` bytes, so factor
+// buffers start on a cache line and suit wide vector loads
+template <typename T, size_t Alignment = 64>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+    template <typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() {}
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t n) {
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, Alignment, n * sizeof(T) > 0 ? n * sizeof(T) : Alignment) != 0) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(ptr);
+    }
+    void deallocate(T* ptr, size_t) { free(ptr); }
+};
+
+template <typename T, typename U, size_t A>
+bool operator==(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) { return true; }
+template <typename T, typename U, size_t A>
+bool operator!=(const AlignedAllocator<T, A>&, const AlignedAllocator<U, A>&) { return false; }
+
+typedef std::vector<double, AlignedAllocator<double, 64>> FactorBuffer;
+
+// Table over discrete variables. Entries are row-major with the last
+// variable varying fastest; strides[i] is the step of variable i.
+class Factor {
+public:
+    std::vector<int> vars;     // Node ids
+    std::vector<int> cards;    // Number of states of each variable
+    std::vector<size_t> strides;
+    FactorBuffer values;
+
+    Factor();
+    Factor(const std::vector<int>& vars, const std::vector<int>& cards, double fill = 1.0);
+
+    size_t size() const { return values.size(); }
+    size_t tableSize() const;     // Product of cards, what size() should be
+    int position(int var) const;  // Index of var in vars, -1 if absent
+    size_t indexOf(const std::vector<int>& states) const;
+    // Stride of each of this factor's variables inside `other` (0 where
+    // `other` does not have the variable)
+    std::vector<size_t> linkedStrides(const Factor& other) const;
+    bool covers(const Factor& other) const;  // other.vars is a subset of vars
+
+    void setValues(const std::vector<double>& table);
+    // this *= other, broadcasting other over the variables it lacks. Fails
+    // if other is not covered or its table does not match its cards.
+    bool multiply(const Factor& other);
+    // Sum out every variable that `out` lacks; out.vars must be a subset
+    bool marginalizeInto(Factor& out) const;
+    void normalize();
+};
+
+// Odometer over the joint states of a table in storage order. It also
+// tracks the matching offset into a second table given that table's
+// stride per variable, so walking never allocates per entry.
+class FactorCursor {
+public:
+    FactorCursor(const std::vector<int>& cards, const std::vector<size_t>& linked_strides);
+
+    const std::vector<int>& states() const { return current; }
+    size_t linked() const { return offset; }
+
+    void next() {
+        for (int j = (int)current.size() - 1; j >= 0; j--) {
+            if (++current[j] < cards[j]) {
+                offset += strides[j];
+                return;
+            }
+            offset -= strides[j] * (cards[j] - 1);
+            current[j] = 0;
+        }
+    }
+
+private:
+    const std::vector<int>& cards;
+    const std::vector<size_t>& strides;
+    std::vector<int> current;
+    size_t offset;
+};
+
+#endif // FACTOR_H
@@ -0,0 +1,565 @@
+#include "factor_ops.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define FACTOR_OPS_X86 1
+#include <immintrin.h>
+#endif
+
+// Kernels over flat runs of n doubles. Runs are not assumed to be aligned.
+struct FactorKernels {
+    SimdLevel level;
+    void (*mul)(double* dst, const double* src, size_t n);
+    void (*scale)(double* dst, double factor, size_t n);
+    void (*add)(double* dst, const double* src, size_t n);
+    void (*max)(double* dst, const double* src, size_t n);
+    double (*sum)(const double* src, size_t n);
+    double (*reduceMax)(const double* src, size_t n);
+    // sum_t exp(src[t] - shift)
+    double (*expSum)(const double* src, double shift, size_t n);
+    // acc[t] += exp(src[t] - shift[t])
+    void (*expAccumulate)(double* acc, const double* src, const double* shift, size_t n);
+};
+
+// Lower bound for exponents; exp(-708) is still a normal double
+static const double EXP_FLOOR = -708.0;
+
+// Scalar kernels
+static void scalarMul(double* dst, const double* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] *= src[i];
+}
+
+static void scalarScale(double* dst, double factor, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] *= factor;
+}
+
+static void scalarAdd(double* dst, const double* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] += src[i];
+}
+
+static void scalarMax(double* dst, const double* src, size_t n) {
+    for (size_t i = 0; i < n; i++) dst[i] = std::max(dst[i], src[i]);
+}
+
+static double scalarSum(const double* src, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) sum += src[i];
+    return sum;
+}
+
+static double scalarReduceMax(const double* src, size_t n) {
+    double best = -std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < n; i++) best = std::max(best, src[i]);
+    return best;
+}
+
+// Differences of -inf (log 0) are NaN; the floor catches them as well
+static double flooredExp(double x) {
+    return std::exp(x > EXP_FLOOR ? x : EXP_FLOOR);
+}
+
+static double scalarExpSum(const double* src, double shift, size_t n) {
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) sum += flooredExp(src[i] - shift);
+    return sum;
+}
+
+static void scalarExpAccumulate(double* acc, const double* src, const double* shift, size_t n) {
+    for (size_t i = 0; i < n; i++) acc[i] += flooredExp(src[i] - shift[i]);
+}
+
+static const FactorKernels scalar_kernels = {
+    SimdLevel::SCALAR, scalarMul, scalarScale, scalarAdd, scalarMax,
+    scalarSum, scalarReduceMax, scalarExpSum, scalarExpAccumulate
+};
+
+#ifdef FACTOR_OPS_X86
+
+// exp(r) on |r| <= ln(2)/2: Taylor series to degree 12, error below 2e-16
+static const double EXP_COEFFS[13] = {
+    1.0, 1.0, 1.0 / 2, 1.0 / 6, 1.0 / 24, 1.0 / 120, 1.0 / 720, 1.0 / 5040,
+    1.0 / 40320, 1.0 / 362880, 1.0 / 3628800, 1.0 / 39916800, 1.0 / 479001600
+};
+static const double LOG2E = 1.4426950408889634;
+// ln(2) split so that n * LN2_HI is exact for the n that occur here
+static const double LN2_HI = 6.93145751953125e-1;
+static const double LN2_LO = 1.42860682030941723212e-6;
+
+// AVX2 kernels
+__attribute__((target("avx2,fma")))
+static inline double hsum256(__m256d v) {
+    __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+static inline double hmax256(__m256d v) {
+    __m128d lo = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_max_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+// exp(x) for x <= 0, range reduced to 2^n * exp(r)
+__attribute__((target("avx2,fma")))
+static inline __m256d exp256(__m256d x) {
+    x = _mm256_max_pd(x, _mm256_set1_pd(EXP_FLOOR));  // NaN lanes become the floor
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)),
+                                _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_HI), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(LN2_LO), r);
+    __m256d p = _mm256_set1_pd(EXP_COEFFS[12]);
+    for (int k = 11; k >= 0; k--) {
+        p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(EXP_COEFFS[k]));
+    }
+    __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+    e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Mul(double* dst, const double* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+    }
+    for (; i < n; i++) dst[i] *= src[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Scale(double* dst, double factor, size_t n) {
+    __m256d f = _mm256_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_mul_pd(_mm256_loadu_pd(dst + i), f));
+    }
+    for (; i < n; i++) dst[i] *= factor;
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Add(double* dst, const double* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_add_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+    }
+    for (; i < n; i++) dst[i] += src[i];
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2Max(double* dst, const double* src, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        _mm256_storeu_pd(dst + i, _mm256_max_pd(_mm256_loadu_pd(dst + i), _mm256_loadu_pd(src + i)));
+    }
+    for (; i < n; i++) dst[i] = std::max(dst[i], src[i]);
+}
+
+__attribute__((target("avx2,fma")))
+static double avx2Sum(const double* src, size_t n) {
+    __m256d a = _mm256_setzero_pd();
+    __m256d b = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a = _mm256_add_pd(a, _mm256_loadu_pd(src + i));
+        b = _mm256_add_pd(b, _mm256_loadu_pd(src + i + 4));
+    }
+    for (; i + 4 <= n; i += 4) {
+        a = _mm256_add_pd(a, _mm256_loadu_pd(src + i));
+    }
+    double sum = hsum256(_mm256_add_pd(a, b));
+    for (; i < n; i++) sum += src[i];
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static double avx2ReduceMax(const double* src, size_t n) {
+    double best = -std::numeric_limits<double>::infinity();
+    size_t i = 0;
+    if (n >= 4) {
+        __m256d m = _mm256_loadu_pd(src);
+        for (i = 4; i + 4 <= n; i += 4) {
+            m = _mm256_max_pd(m, _mm256_loadu_pd(src + i));
+        }
+        best = hmax256(m);
+    }
+    for (; i < n; i++) best = std::max(best, src[i]);
+    return best;
+}
+
+__attribute__((target("avx2,fma")))
+static double avx2ExpSum(const double* src, double shift, size_t n) {
+    __m256d s = _mm256_set1_pd(shift);
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm256_add_pd(acc, exp256(_mm256_sub_pd(_mm256_loadu_pd(src + i), s)));
+    }
+    double sum = hsum256(acc);
+    for (; i < n; i++) sum += flooredExp(src[i] - shift);
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void avx2ExpAccumulate(double* acc, const double* src, const double* shift, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d x = _mm256_sub_pd(_mm256_loadu_pd(src + i), _mm256_loadu_pd(shift + i));
+        _mm256_storeu_pd(acc + i, _mm256_add_pd(_mm256_loadu_pd(acc + i), exp256(x)));
+    }
+    for (; i < n; i++) acc[i] += flooredExp(src[i] - shift[i]);
+}
+
+static const FactorKernels avx2_kernels = {
+    SimdLevel::AVX2, avx2Mul, avx2Scale, avx2Add, avx2Max,
+    avx2Sum, avx2ReduceMax, avx2ExpSum, avx2ExpAccumulate
+};
+
+// AVX-512 kernels. GCC's AVX-512 intrinsics start from deliberately
+// undefined registers, which it then reports as uninitialized.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+__attribute__((target("avx512f")))
+static inline __m512d exp512(__m512d x) {
+    x = _mm512_max_pd(x, _mm512_set1_pd(EXP_FLOOR));
+    __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(LOG2E)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_HI), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(LN2_LO), r);
+    __m512d p = _mm512_set1_pd(EXP_COEFFS[12]);
+    for (int k = 11; k >= 0; k--) {
+        p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(EXP_COEFFS[k]));
+    }
+    __m512i e = _mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(n));
+    e = _mm512_slli_epi64(_mm512_add_epi64(e, _mm512_set1_epi64(1023)), 52);
+    return _mm512_mul_pd(p, _mm512_castsi512_pd(e));
+}
+
+__attribute__((target("avx512f")))
+static void avx512Mul(double* dst, const double* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_mul_pd(_mm512_loadu_pd(dst + i), _mm512_loadu_pd(src + i)));
+    }
+    for (; i < n; i++) dst[i] *= src[i];
+}
+
+__attribute__((target("avx512f")))
+static void avx512Scale(double* dst, double factor, size_t n) {
+    __m512d f = _mm512_set1_pd(factor);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_mul_pd(_mm512_loadu_pd(dst + i), f));
+    }
+    for (; i < n; i++) dst[i] *= factor;
+}
+
+__attribute__((target("avx512f")))
+static void avx512Add(double* dst, const double* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_add_pd(_mm512_loadu_pd(dst + i), _mm512_loadu_pd(src + i)));
+    }
+    for (; i < n; i++) dst[i] += src[i];
+}
+
+__attribute__((target("avx512f")))
+static void avx512Max(double* dst, const double* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm512_storeu_pd(dst + i, _mm512_max_pd(_mm512_loadu_pd(dst + i), _mm512_loadu_pd(src + i)));
+    }
+    for (; i < n; i++) dst[i] = std::max(dst[i], src[i]);
+}
+
+__attribute__((target("avx512f")))
+static double avx512Sum(const double* src, size_t n) {
+    __m512d a = _mm512_setzero_pd();
+    __m512d b = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a = _mm512_add_pd(a, _mm512_loadu_pd(src + i));
+        b = _mm512_add_pd(b, _mm512_loadu_pd(src + i + 8));
+    }
+    for (; i + 8 <= n; i += 8) {
+        a = _mm512_add_pd(a, _mm512_loadu_pd(src + i));
+    }
+    double sum = _mm512_reduce_add_pd(_mm512_add_pd(a, b));
+    for (; i < n; i++) sum += src[i];
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static double avx512ReduceMax(const double* src, size_t n) {
+    double best = -std::numeric_limits<double>::infinity();
+    size_t i = 0;
+    if (n >= 8) {
+        __m512d m = _mm512_loadu_pd(src);
+        for (i = 8; i + 8 <= n; i += 8) {
+            m = _mm512_max_pd(m, _mm512_loadu_pd(src + i));
+        }
+        best = _mm512_reduce_max_pd(m);
+    }
+    for (; i < n; i++) best = std::max(best, src[i]);
+    return best;
+}
+
+__attribute__((target("avx512f")))
+static double avx512ExpSum(const double* src, double shift, size_t n) {
+    __m512d s = _mm512_set1_pd(shift);
+    __m512d acc = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc = _mm512_add_pd(acc, exp512(_mm512_sub_pd(_mm512_loadu_pd(src + i), s)));
+    }
+    double sum = _mm512_reduce_add_pd(acc);
+    for (; i < n; i++) sum += flooredExp(src[i] - shift);
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static void avx512ExpAccumulate(double* acc, const double* src, const double* shift, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d x = _mm512_sub_pd(_mm512_loadu_pd(src + i), _mm512_loadu_pd(shift + i));
+        _mm512_storeu_pd(acc + i, _mm512_add_pd(_mm512_loadu_pd(acc + i), exp512(x)));
+    }
+    for (; i < n; i++) acc[i] += flooredExp(src[i] - shift[i]);
+}
+
+static const FactorKernels avx512_kernels = {
+    SimdLevel::AVX512, avx512Mul, avx512Scale, avx512Add, avx512Max,
+    avx512Sum, avx512ReduceMax, avx512ExpSum, avx512ExpAccumulate
+};
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+#endif // FACTOR_OPS_X86
+
+// Runtime dispatch
+static std::atomic<const FactorKernels*> active_kernels(nullptr);
+
+static const FactorKernels* kernelsFor(SimdLevel level) {
+#ifdef FACTOR_OPS_X86
+    if (level == SimdLevel::AVX512) return &avx512_kernels;
+    if (level == SimdLevel::AVX2) return &avx2_kernels;
+#endif
+    (void)level;
+    return &scalar_kernels;
+}
+
+static const FactorKernels& kernels() {
+    const FactorKernels* k = active_kernels.load(std::memory_order_acquire);
+    if (!k) {
+        k = kernelsFor(detectSimdLevel());
+        active_kernels.store(k, std::memory_order_release);
+    }
+    return *k;
+}
+
+SimdLevel detectSimdLevel() {
+#ifdef FACTOR_OPS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return SimdLevel::AVX2;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+
+SimdLevel activeSimdLevel() {
+    return kernels().level;
+}
+
+bool setSimdLevel(SimdLevel level) {
+    if ((int)level > (int)detectSimdLevel()) {
+        return false;
+    }
+    active_kernels.store(kernelsFor(level), std::memory_order_release);
+    return true;
+}
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::AVX2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+// Split a table walk into an outer odometer and inner blocks. Inside a
+// block the linked offset either advances with the table (contiguous) or
+// stays put (broadcast / reduction).
+class BlockPlan {
+public:
+    size_t total;
+    size_t block;
+    bool contiguous;
+    std::vector<int> outer_cards;
+    std::vector<size_t> outer_linked;
+
+    BlockPlan(const std::vector<int>& cards, const std::vector<size_t>& linked)
+        : total(1), block(1), contiguous(true) {
+        for (int card : cards) {
+            total *= card;
+        }
+        int mode = -1;  // -1 undecided, 0 broadcast, 1 contiguous
+        int j = (int)cards.size() - 1;
+        for (; j >= 0; j--) {
+            if (cards[j] > 1) {
+                int var_mode = linked[j] == block ? 1 : (linked[j] == 0 ? 0 : -1);
+                if (var_mode < 0 || (mode >= 0 && var_mode != mode)) break;
+                mode = var_mode;
+            }
+            block *= cards[j];
+        }
+        contiguous = mode != 0;
+        outer_cards.assign(cards.begin(), cards.begin() + (j + 1));
+        outer_linked.assign(linked.begin(), linked.begin() + (j + 1));
+    }
+};
+
+void stridedProduct(double* table, const std::vector<int>& cards,
+                    const std::vector<size_t>& linked, const double* other) {
+    const FactorKernels& k = kernels();
+    BlockPlan plan(cards, linked);
+    FactorCursor cursor(plan.outer_cards, plan.outer_linked);
+    for (size_t base = 0; base < plan.total; base += plan.block) {
+        if (plan.contiguous) {
+            k.mul(table + base, other + cursor.linked(), plan.block);
+        } else {
+            k.scale(table + base, other[cursor.linked()], plan.block);
+        }
+        cursor.next();
+    }
+}
+
+void stridedSumInto(const double* table, const std::vector<int>& cards,
+                    const std::vector<size_t>& linked, double* out) {
+    const FactorKernels& k = kernels();
+    BlockPlan plan(cards, linked);
+    FactorCursor cursor(plan.outer_cards, plan.outer_linked);
+    for (size_t base = 0; base < plan.total; base += plan.block) {
+        if (plan.contiguous) {
+            k.add(out + cursor.linked(), table + base, plan.block);
+        } else {
+            out[cursor.linked()] += k.sum(table + base, plan.block);
+        }
+        cursor.next();
+    }
+}
+
+void stridedMaxInto(const double* table, const std::vector<int>& cards,
+                    const std::vector<size_t>& linked, double* out) {
+    const FactorKernels& k = kernels();
+    BlockPlan plan(cards, linked);
+    FactorCursor cursor(plan.outer_cards, plan.outer_linked);
+    for (size_t base = 0; base < plan.total; base += plan.block) {
+        if (plan.contiguous) {
+            k.max(out + cursor.linked(), table + base, plan.block);
+        } else {
+            double& slot = out[cursor.linked()];
+            slot = std::max(slot, k.reduceMax(table + base, plan.block));
+        }
+        cursor.next();
+    }
+}
+
+// Both tables must match their cards and `small` must be covered by `big`
+static bool compatible(const Factor& big, const Factor& small) {
+    return big.values.size() == big.tableSize() &&
+           small.values.size() == small.tableSize() && big.covers(small);
+}
+
+bool factorProduct(Factor& dst, const Factor& src) {
+    if (!compatible(dst, src)) {
+        return false;
+    }
+    stridedProduct(dst.values.data(), dst.cards, dst.linkedStrides(src), src.values.data());
+    return true;
+}
+
+bool factorSumOut(const Factor& src, Factor& out) {
+    if (!compatible(src, out)) {
+        return false;
+    }
+    std::fill(out.values.begin(), out.values.end(), 0.0);
+    stridedSumInto(src.values.data(), src.cards, src.linkedStrides(out), out.values.data());
+    return true;
+}
+
+bool factorMaxOut(const Factor& src, Factor& out) {
+    if (!compatible(src, out)) {
+        return false;
+    }
+    std::fill(out.values.begin(), out.values.end(), -std::numeric_limits<double>::infinity());
+    stridedMaxInto(src.values.data(), src.cards, src.linkedStrides(out), out.values.data());
+    return true;
+}
+
+bool factorLogSumExp(const Factor& src, Factor& out) {
+    // Shift by the max of each output entry so the exponentials cannot overflow
+    if (!factorMaxOut(src, out)) {
+        return false;
+    }
+    const FactorKernels& k = kernels();
+    const double neg_inf = -std::numeric_limits<double>::infinity();
+    std::vector<size_t> linked = src.linkedStrides(out);
+    FactorBuffer acc(out.values.size(), 0.0);
+    BlockPlan plan(src.cards, linked);
+    FactorCursor cursor(plan.outer_cards, plan.outer_linked);
+    for (size_t base = 0; base < plan.total; base += plan.block) {
+        size_t offset = cursor.linked();
+        if (plan.contiguous) {
+            k.expAccumulate(acc.data() + offset, src.values.data() + base,
+                            out.values.data() + offset, plan.block);
+        } else if (out.values[offset] != neg_inf) {
+            acc[offset] += k.expSum(src.values.data() + base, out.values[offset], plan.block);
+        }
+        cursor.next();
+    }
+    for (size_t i = 0; i < out.values.size(); i++) {
+        if (out.values[i] != neg_inf) {
+            out.values[i] += std::log(acc[i]);
+        }
+    }
+    return true;
+}
+
+void factorNormalize(Factor& factor) {
+    double sum = tableSum(factor.values.data(), factor.values.size());
+    if (sum > 0.0) {
+        tableScale(factor.values.data(), 1.0 / sum, factor.values.size());
+    }
+}
+
+Factor sumOutVariables(const Factor& src, const std::vector<int>& vars) {
+    std::vector<int> keep_vars;
+    std::vector<int> keep_cards;
+    for (size_t i = 0; i < src.vars.size(); i++) {
+        if (std::find(vars.begin(), vars.end(), src.vars[i]) == vars.end()) {
+            keep_vars.push_back(src.vars[i]);
+            keep_cards.push_back(src.cards[i]);
+        }
+    }
+    Factor out(keep_vars, keep_cards, 0.0);
+    factorSumOut(src, out);
+    return out;
+}
+
+double tableSum(const double* table, size_t n) {
+    return kernels().sum(table, n);
+}
+
+void tableScale(double* table, double factor, size_t n) {
+    kernels().scale(table, factor, n);
+}
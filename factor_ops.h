@@ -0,0 +1,60 @@
+#ifndef FACTOR_OPS_H
+#define FACTOR_OPS_H
+
+#include "factor.h"
+#include <vector>
+#include <cstddef>
+
+// Instruction sets the factor kernels can run on
+enum class SimdLevel {
+    SCALAR,
+    AVX2,
+    AVX512
+};
+
+// Best level supported by this CPU (and compiler)
+SimdLevel detectSimdLevel();
+// Level in use; picked by detectSimdLevel on first use
+SimdLevel activeSimdLevel();
+// Force a level, e.g. to compare against the scalar path. Fails if the CPU
+// does not support it.
+bool setSimdLevel(SimdLevel level);
+const char* simdLevelName(SimdLevel level);
+
+// Strided table kernels. `cards` describes a row-major table (last variable
+// fastest) and linked[j] is the stride of variable j in the second table
+// (0 where it lacks the variable). The innermost run of variables is handed
+// to the vector kernels as one contiguous or broadcast block.
+
+// table[i] *= other[linked offset of i]
+void stridedProduct(double* table, const std::vector<int>& cards,
+                    const std::vector<size_t>& linked, const double* other);
+// out[linked offset of i] += table[i] (out is not cleared first)
+void stridedSumInto(const double* table, const std::vector<int>& cards,
+                    const std::vector<size_t>& linked, double* out);
+// out[linked offset of i] = max(out[...], table[i])
+void stridedMaxInto(const double* table, const std::vector<int>& cards,
+                    const std::vector<size_t>& linked, double* out);
+
+// Factor algebra. The second factor's variables must be a subset of the
+// first's with matching cardinalities; otherwise nothing is done and false
+// is returned.
+
+// dst *= src, broadcasting src over the variables it lacks
+bool factorProduct(Factor& dst, const Factor& src);
+// out = src with every variable out lacks summed out
+bool factorSumOut(const Factor& src, Factor& out);
+// out = src with every variable out lacks maxed out
+bool factorMaxOut(const Factor& src, Factor& out);
+// Log domain: out = log sum exp(src) over every variable out lacks
+bool factorLogSumExp(const Factor& src, Factor& out);
+// Scale to sum to one; tables that sum to zero are left alone
+void factorNormalize(Factor& factor);
+// Sum out the given variables, keeping the rest in their current order
+Factor sumOutVariables(const Factor& src, const std::vector<int>& vars);
+
+// Flat buffer helpers on the active kernels
+double tableSum(const double* table, size_t n);
+void tableScale(double* table, double factor, size_t n);
+
+#endif // FACTOR_OPS_H
@@ -2,6 +2,7 @@
 #define FRAMEWORK_EXPORTERS_H
 
 #include "qpu_circuit.h"
+#include "output_sink.h"
 #include <string>
 #include <vector>
 
@@ -21,7 +22,14 @@ enum class Framework {
 class FrameworkExporter {
 public:
     virtual ~FrameworkExporter() = default;
-    virtual std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") = 0;
+    // Emit the program gate by gate. Exporters keep no state, so several
+    // may write the same circuit concurrently.
+    virtual void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) = 0;
+    // The whole program as one string
+    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit");
+    // Stream the program into path through the sink's buffer, without
+    // building it in memory first. False if the file cannot be written.
+    bool exportToFile(const QPUCircuit& circuit, const std::string& circuit_name, const std::string& path);
     virtual std::string getFileExtension() const = 0;
     virtual std::string getFrameworkName() const = 0;
 };
@@ -29,7 +37,7 @@ public:
 // QASM Exporter
 class QASMExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "qasm"; }
     std::string getFrameworkName() const override { return "OpenQASM"; }
 };
@@ -37,7 +45,7 @@ public:
 // Qiskit Exporter
 class QiskitExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "py"; }
     std::string getFrameworkName() const override { return "Qiskit"; }
 };
@@ -45,7 +53,7 @@ public:
 // Cirq Exporter
 class CirqExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "py"; }
     std::string getFrameworkName() const override { return "Cirq"; }
 };
@@ -53,7 +61,7 @@ public:
 // PennyLane Exporter
 class PennyLaneExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "py"; }
     std::string getFrameworkName() const override { return "PennyLane"; }
 };
@@ -61,7 +69,7 @@ public:
 // Q# Exporter
 class QSharpExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "qs"; }
     std::string getFrameworkName() const override { return "QSharp"; }
 };
@@ -69,7 +77,7 @@ public:
 // AWS Braket Exporter
 class BraketExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "py"; }
     std::string getFrameworkName() const override { return "Braket"; }
 };
@@ -77,7 +85,7 @@ public:
 // Qulacs Exporter
 class QulacsExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "py"; }
     std::string getFrameworkName() const override { return "Qulacs"; }
 };
@@ -85,7 +93,7 @@ public:
 // TensorFlow Quantum Exporter
 class TFQExporter : public FrameworkExporter {
 public:
-    std::string exportCircuit(const QPUCircuit& circuit, const std::string& circuit_name = "mrf_circuit") override;
+    void writeCircuit(const QPUCircuit& circuit, const std::string& circuit_name, OutputSink& out) override;
     std::string getFileExtension() const override { return "py"; }
     std::string getFrameworkName() const override { return "TensorFlow Quantum"; }
 };
@@ -2,6 +2,48 @@
 #include <iostream>
 #include <algorithm>
 #include <sstream>
+#include <utility>
+
+// DenseCPT implementation
+DenseCPT::DenseCPT() : num_states(0) {
+}
+
+void DenseCPT::reset(int num_states, const std::vector<int>& parent_cards) {
+    this->num_states = num_states;
+    this->parent_cards = parent_cards;
+    strides.assign(parent_cards.size(), 0);
+    size_t rows = 1;
+    for (int p = (int)parent_cards.size() - 1; p >= 0; p--) {
+        strides[p] = rows * num_states;
+        rows *= parent_cards[p];
+    }
+    probs.assign(rows * num_states, 1.0);
+    row_set.assign(rows, false);
+}
+
+bool DenseCPT::hasShape(int num_states, const std::vector<int>& parent_cards) const {
+    return !empty() && this->num_states == num_states && this->parent_cards == parent_cards;
+}
+
+bool DenseCPT::rowIndex(const std::vector<int>& parent_states, size_t& row) const {
+    if (parent_states.size() != parent_cards.size()) {
+        return false;
+    }
+    row = 0;
+    for (size_t p = 0; p < parent_cards.size(); p++) {
+        if (parent_states[p] < 0 || parent_states[p] >= parent_cards[p]) {
+            return false;
+        }
+        row = row * parent_cards[p] + parent_states[p];
+    }
+    return true;
+}
+
+void DenseCPT::setRow(size_t row, const double* values, size_t count) {
+    count = std::min(count, (size_t)num_states);
+    std::copy(values, values + count, probs.begin() + row * num_states);
+    row_set[row] = true;
+}
 
 // Node implementation
 Node::Node(int id, const std::string& name, int num_states) 
@@ -9,8 +51,15 @@ Node::Node(int id, const std::string& name, int num_states)
     potential.resize(num_states, 1.0);  // Default uniform potential
 }
 
-void Node::setCPT(const std::map<std::vector<int>, std::vector<double>>& cpt_table) {
-    cpt = cpt_table;
+void Node::setCPT(const std::map<std::vector<int>, std::vector<double>>& cpt_table,
+                  const std::vector<int>& parent_cards) {
+    cpt.reset(num_states, parent_cards);
+    for (const auto& entry : cpt_table) {
+        size_t row;
+        if (cpt.rowIndex(entry.first, row)) {
+            cpt.setRow(row, entry.second.data(), entry.second.size());
+        }
+    }
     has_cpt = true;
 }
 
@@ -23,17 +72,282 @@ void Edge::setPotential(const std::vector<std::vector<double>>& pot) {
     potential = pot;
 }
 
+// IdIndex implementation
+IdIndex::IdIndex() : count(0) {
+}
+
+void IdIndex::insert(int id, int pos) {
+    if (find(id) >= 0) {
+        return;
+    }
+    // Keep the dense table proportional to the number of entries
+    size_t dense_limit = 2 * (count + 1) + 1024;
+    if (id >= 0 && (size_t)id < dense_limit) {
+        if ((size_t)id >= dense.size()) {
+            dense.resize(id + 1, -1);
+        }
+        dense[id] = pos;
+    } else {
+        sparse[id] = pos;
+    }
+    count++;
+}
+
+int IdIndex::find(int id) const {
+    if (id >= 0 && (size_t)id < dense.size() && dense[id] >= 0) {
+        return dense[id];
+    }
+    if (!sparse.empty()) {
+        auto it = sparse.find(id);
+        if (it != sparse.end()) {
+            return it->second;
+        }
+    }
+    return -1;
+}
+
+void IdIndex::clear() {
+    dense.clear();
+    sparse.clear();
+    count = 0;
+}
+
+// CSRAdjacency implementation
+void CSRAdjacency::build(const std::vector<int>& ids, const AdjacencyMap& adjacency) {
+    clear();
+    vertex_ids.reserve(ids.size());
+    for (int id : ids) {
+        if (id_index.find(id) < 0) {
+            id_index.insert(id, (int)vertex_ids.size());
+            vertex_ids.push_back(id);
+        }
+    }
+    // Ids that only appear in edges still need a vertex
+    size_t total = 0;
+    for (const auto& entry : adjacency) {
+        if (id_index.find(entry.first) < 0) {
+            id_index.insert(entry.first, (int)vertex_ids.size());
+            vertex_ids.push_back(entry.first);
+        }
+        for (int n : entry.second) {
+            if (id_index.find(n) < 0) {
+                id_index.insert(n, (int)vertex_ids.size());
+                vertex_ids.push_back(n);
+            }
+        }
+        total += entry.second.size();
+    }
+    
+    size_t num_vertices = vertex_ids.size();
+    offsets.assign(num_vertices + 1, 0);
+    for (const auto& entry : adjacency) {
+        offsets[id_index.find(entry.first) + 1] = entry.second.size();
+    }
+    for (size_t v = 0; v < num_vertices; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    neighbors.resize(total);
+    for (const auto& entry : adjacency) {
+        int v = id_index.find(entry.first);
+        int* out = neighbors.data() + offsets[v];
+        for (int n : entry.second) {
+            *out++ = id_index.find(n);
+        }
+        std::sort(neighbors.begin() + offsets[v], neighbors.begin() + offsets[v + 1]);
+    }
+}
+
+void CSRAdjacency::assign(const int* ids, size_t num_vertices, const uint64_t* offsets,
+                          const int* neighbors) {
+    clear();
+    vertex_ids.assign(ids, ids + num_vertices);
+    for (size_t v = 0; v < num_vertices; v++) {
+        id_index.insert(ids[v], (int)v);
+    }
+    this->offsets.assign(offsets, offsets + num_vertices + 1);
+    this->neighbors.assign(neighbors, neighbors + offsets[num_vertices]);
+}
+
+void CSRAdjacency::clear() {
+    vertex_ids.clear();
+    offsets.clear();
+    neighbors.clear();
+    id_index.clear();
+}
+
+bool CSRAdjacency::hasEdge(int u, int v) const {
+    if (u < 0 || v < 0) {
+        return false;
+    }
+    return std::binary_search(neighborsBegin(u), neighborsEnd(u), v);
+}
+
+AdjacencyMap CSRAdjacency::toAdjacencyList() const {
+    AdjacencyMap adjacency;
+    for (size_t v = 0; v < vertex_ids.size(); v++) {
+        NeighborSet& out = adjacency[vertex_ids[v]];
+        for (const int* it = neighborsBegin(v); it != neighborsEnd(v); ++it) {
+            out.insert(vertex_ids[*it]);
+        }
+    }
+    return adjacency;
+}
+
+CSRAdjacency CSRAdjacency::symmetrized() const {
+    size_t num_vertices = vertex_ids.size();
+    CSRAdjacency sym;
+    sym.vertex_ids = vertex_ids;
+    sym.id_index = id_index;
+    sym.offsets.assign(num_vertices + 1, 0);
+    for (size_t v = 0; v < num_vertices; v++) {
+        for (const int* it = neighborsBegin(v); it != neighborsEnd(v); ++it) {
+            if (*it == (int)v) continue;
+            sym.offsets[v + 1]++;
+            sym.offsets[*it + 1]++;
+        }
+    }
+    for (size_t v = 0; v < num_vertices; v++) {
+        sym.offsets[v + 1] += sym.offsets[v];
+    }
+    sym.neighbors.resize(sym.offsets[num_vertices]);
+    std::vector<size_t> fill(sym.offsets.begin(), sym.offsets.end() - 1);
+    for (size_t v = 0; v < num_vertices; v++) {
+        for (const int* it = neighborsBegin(v); it != neighborsEnd(v); ++it) {
+            if (*it == (int)v) continue;
+            sym.neighbors[fill[v]++] = *it;
+            sym.neighbors[fill[*it]++] = (int)v;
+        }
+    }
+    // Sort and drop the duplicates left by edges stored in both directions
+    std::vector<int> compact;
+    compact.reserve(sym.neighbors.size());
+    size_t begin = 0;
+    for (size_t v = 0; v < num_vertices; v++) {
+        size_t end = sym.offsets[v + 1];
+        std::sort(sym.neighbors.begin() + begin, sym.neighbors.begin() + end);
+        size_t start = compact.size();
+        for (size_t i = begin; i < end; i++) {
+            if (compact.size() == start || compact.back() != sym.neighbors[i]) {
+                compact.push_back(sym.neighbors[i]);
+            }
+        }
+        begin = end;
+        sym.offsets[v] = start;
+    }
+    sym.offsets[num_vertices] = compact.size();
+    sym.neighbors.swap(compact);
+    return sym;
+}
+
+// Pack an ordered (from, to) pair into a single hash key
+static inline uint64_t edgeKey(int from, int to) {
+    return ((uint64_t)(uint32_t)from << 32) | (uint32_t)to;
+}
+
 // GraphicalModel implementation
-GraphicalModel::GraphicalModel(GraphType t) : type(t) {
+GraphicalModel::GraphicalModel(GraphType t) : type(t), frozen(false), family_valid(false) {
+}
+
+void GraphicalModel::indexEdge(size_t pos) {
+    const Edge& edge = edges[pos];
+    // emplace keeps the earliest edge, matching the original scan order
+    edge_index.emplace(edgeKey(edge.from, edge.to), pos);
+    if (!edge.directed) {
+        edge_index.emplace(edgeKey(edge.to, edge.from), pos);
+    }
+}
+
+void GraphicalModel::rebuildIndices() {
+    node_index.clear();
+    edge_index.clear();
+    adjacency_list.clear();
+    csr.clear();
+    frozen = false;
+    family_valid = false;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        node_index.insert(nodes[i].id, (int)i);
+        adjacency_list[nodes[i].id];
+    }
+    edge_index.reserve(edges.size() * 2);
+    for (size_t i = 0; i < edges.size(); i++) {
+        const Edge& edge = edges[i];
+        indexEdge(i);
+        adjacency_list[edge.from].insert(edge.to);
+        if (!edge.directed || type == GraphType::UNDIRECTED) {
+            adjacency_list[edge.to].insert(edge.from);
+        }
+    }
+}
+
+void GraphicalModel::restoreFrozen(CSRAdjacency&& adjacency) {
+    node_index.clear();
+    edge_index.clear();
+    adjacency_list.clear();
+    family_valid = false;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        node_index.insert(nodes[i].id, (int)i);
+    }
+    edge_index.reserve(edges.size() * 2);
+    for (size_t i = 0; i < edges.size(); i++) {
+        indexEdge(i);
+    }
+    csr = std::move(adjacency);
+    frozen = true;
+}
+
+void GraphicalModel::freezeAdjacency() {
+    if (frozen) {
+        return;
+    }
+    csr = buildAdjacency();
+    adjacency_list.clear();
+    frozen = true;
+}
+
+void GraphicalModel::thawAdjacency() {
+    if (!frozen) {
+        return;
+    }
+    adjacency_list = csr.toAdjacencyList();
+    csr.clear();
+    frozen = false;
+}
+
+CSRAdjacency GraphicalModel::buildAdjacency() const {
+    if (frozen) {
+        return csr;
+    }
+    std::vector<int> ids;
+    ids.reserve(nodes.size());
+    for (const auto& node : nodes) {
+        ids.push_back(node.id);
+    }
+    CSRAdjacency adjacency;
+    adjacency.build(ids, adjacency_list);
+    return adjacency;
 }
 
 void GraphicalModel::addNode(int id, const std::string& name, int num_states) {
+    thawAdjacency();
+    family_valid = false;
     nodes.emplace_back(id, name, num_states);
-    adjacency_list[id] = std::set<int>();
+    node_index.insert(id, (int)nodes.size() - 1);
+    adjacency_list[id] = NeighborSet();
+}
+
+void GraphicalModel::reserve(size_t num_nodes, size_t num_edges) {
+    nodes.reserve(num_nodes);
+    edges.reserve(num_edges);
+    edge_index.reserve(num_edges * 2);
 }
 
 void GraphicalModel::addEdge(int from, int to, bool directed) {
+    thawAdjacency();
+    if (directed) {
+        family_valid = false;
+    }
     edges.emplace_back(from, to, directed);
+    indexEdge(edges.size() - 1);
     adjacency_list[from].insert(to);
     if (!directed || type == GraphType::UNDIRECTED) {
         adjacency_list[to].insert(from);
@@ -57,50 +371,159 @@ void GraphicalModel::setEdgePotential(int from, int to, const std::vector<std::v
 void GraphicalModel::setCPT(int node_id, const std::map<std::vector<int>, std::vector<double>>& cpt_table) {
     Node* node = getNode(node_id);
     if (node) {
-        node->setCPT(cpt_table);
+        node->setCPT(cpt_table, getParentCards(node_id));
     }
 }
 
-std::vector<int> GraphicalModel::getParents(int node_id) const {
-    std::vector<int> parents;
-    for (const auto& edge : edges) {
-        if (edge.to == node_id && edge.directed) {
-            parents.push_back(edge.from);
+bool GraphicalModel::loadCPTRows(int node_id, const std::vector<double>& entries) {
+    return loadCPTRows(node_id, entries.data(), entries.size());
+}
+
+bool GraphicalModel::loadCPTRows(int node_id, const double* entries, size_t count) {
+    Node* node = getNode(node_id);
+    if (!node) {
+        return false;
+    }
+    std::vector<int> parent_cards = getParentCards(node_id);
+    size_t num_parents = parent_cards.size();
+    size_t entry_size = num_parents + node->num_states;
+    if (count % entry_size != 0) {
+        return false;
+    }
+    
+    DenseCPT& cpt = node->cpt;
+    if (!node->has_cpt || !cpt.hasShape(node->num_states, parent_cards)) {
+        cpt.reset(node->num_states, parent_cards);
+    }
+    node->has_cpt = true;
+    
+    bool all_valid = true;
+    for (size_t i = 0; i < count; i += entry_size) {
+        size_t row = 0;
+        bool valid = true;
+        for (size_t p = 0; p < num_parents && valid; p++) {
+            int state = (int)entries[i + p];
+            valid = state >= 0 && state < parent_cards[p];
+            row = row * parent_cards[p] + state;
+        }
+        if (!valid) {
+            all_valid = false;
+            continue;
         }
+        cpt.setRow(row, entries + i + num_parents, node->num_states);
     }
-    return parents;
+    return all_valid;
 }
 
-Node* GraphicalModel::getNode(int id) {
-    for (auto& node : nodes) {
-        if (node.id == id) {
-            return &node;
-        }
+std::vector<int> GraphicalModel::getParentCards(int node_id) const {
+    std::pair<const int*, const int*> parents = parentRange(node_id);
+    std::vector<int> cards;
+    cards.reserve(parents.second - parents.first);
+    for (const int* it = parents.first; it != parents.second; ++it) {
+        const Node* parent = getNode(*it);
+        cards.push_back(parent ? parent->num_states : 2);
     }
-    return nullptr;
+    return cards;
 }
 
-const Node* GraphicalModel::getNode(int id) const {
-    for (const auto& node : nodes) {
-        if (node.id == id) {
-            return &node;
-        }
+void GraphicalModel::buildFamilyIndex() const {
+    size_t num_nodes = nodes.size();
+    parent_offsets.assign(num_nodes + 1, 0);
+    child_offsets.assign(num_nodes + 1, 0);
+    for (const auto& edge : edges) {
+        if (!edge.directed) continue;
+        int from = node_index.find(edge.from);
+        int to = node_index.find(edge.to);
+        if (to >= 0) parent_offsets[to + 1]++;
+        if (from >= 0) child_offsets[from + 1]++;
+    }
+    for (size_t i = 0; i < num_nodes; i++) {
+        parent_offsets[i + 1] += parent_offsets[i];
+        child_offsets[i + 1] += child_offsets[i];
+    }
+    parent_ids.resize(parent_offsets[num_nodes]);
+    child_ids.resize(child_offsets[num_nodes]);
+    
+    // Stable fill so parents keep edge declaration order (CPT rows rely on it)
+    std::vector<size_t> parent_fill(parent_offsets.begin(), parent_offsets.end() - 1);
+    std::vector<size_t> child_fill(child_offsets.begin(), child_offsets.end() - 1);
+    for (const auto& edge : edges) {
+        if (!edge.directed) continue;
+        int from = node_index.find(edge.from);
+        int to = node_index.find(edge.to);
+        if (to >= 0) parent_ids[parent_fill[to]++] = edge.from;
+        if (from >= 0) child_ids[child_fill[from]++] = edge.to;
     }
-    return nullptr;
+    family_valid = true;
 }
 
-Edge* GraphicalModel::getEdge(int from, int to) {
-    for (auto& edge : edges) {
-        if ((edge.from == from && edge.to == to) ||
-            (!edge.directed && edge.from == to && edge.to == from)) {
-            return &edge;
-        }
+std::pair<const int*, const int*> GraphicalModel::parentRange(int node_id) const {
+    if (!family_valid) {
+        buildFamilyIndex();
     }
-    return nullptr;
+    int pos = node_index.find(node_id);
+    if (pos < 0) {
+        return std::make_pair((const int*)nullptr, (const int*)nullptr);
+    }
+    return std::make_pair(parent_ids.data() + parent_offsets[pos],
+                          parent_ids.data() + parent_offsets[pos + 1]);
+}
+
+std::pair<const int*, const int*> GraphicalModel::childRange(int node_id) const {
+    if (!family_valid) {
+        buildFamilyIndex();
+    }
+    int pos = node_index.find(node_id);
+    if (pos < 0) {
+        return std::make_pair((const int*)nullptr, (const int*)nullptr);
+    }
+    return std::make_pair(child_ids.data() + child_offsets[pos],
+                          child_ids.data() + child_offsets[pos + 1]);
+}
+
+std::vector<int> GraphicalModel::getParents(int node_id) const {
+    std::pair<const int*, const int*> range = parentRange(node_id);
+    return std::vector<int>(range.first, range.second);
+}
+
+std::vector<int> GraphicalModel::getChildren(int node_id) const {
+    std::pair<const int*, const int*> range = childRange(node_id);
+    return std::vector<int>(range.first, range.second);
+}
+
+Node* GraphicalModel::getNode(int id) {
+    int pos = node_index.find(id);
+    return pos >= 0 ? &nodes[pos] : nullptr;
+}
+
+const Node* GraphicalModel::getNode(int id) const {
+    int pos = node_index.find(id);
+    return pos >= 0 ? &nodes[pos] : nullptr;
+}
+
+Edge* GraphicalModel::getEdge(int from, int to) {
+    auto it = edge_index.find(edgeKey(from, to));
+    return it != edge_index.end() ? &edges[it->second] : nullptr;
+}
+
+const Edge* GraphicalModel::getEdge(int from, int to) const {
+    auto it = edge_index.find(edgeKey(from, to));
+    return it != edge_index.end() ? &edges[it->second] : nullptr;
 }
 
 std::vector<int> GraphicalModel::getNeighbors(int node_id) const {
     std::vector<int> neighbors;
+    if (frozen) {
+        int v = csr.indexOf(node_id);
+        if (v >= 0) {
+            for (const int* it = csr.neighborsBegin(v); it != csr.neighborsEnd(v); ++it) {
+                neighbors.push_back(csr.vertex_ids[*it]);
+            }
+            // Local order follows node declaration order; callers expect ids sorted
+            std::sort(neighbors.begin(), neighbors.end());
+        }
+        return neighbors;
+    }
     auto it = adjacency_list.find(node_id);
     if (it != adjacency_list.end()) {
         neighbors.assign(it->second.begin(), it->second.end());
@@ -109,6 +532,9 @@ std::vector<int> GraphicalModel::getNeighbors(int node_id) const {
 }
 
 bool GraphicalModel::hasEdge(int from, int to) const {
+    if (frozen) {
+        return csr.hasEdge(csr.indexOf(from), csr.indexOf(to));
+    }
     auto it = adjacency_list.find(from);
     if (it != adjacency_list.end()) {
         return it->second.find(to) != it->second.end();
@@ -135,26 +561,39 @@ void GraphicalModel::print() const {
                   << (edge.directed ? " (directed)" : " (undirected)") << "\n";
     }
     // Print CPTs if available
+    std::vector<int> states;
     for (const auto& node : nodes) {
         if (node.has_cpt && !node.cpt.empty()) {
+            const DenseCPT& cpt = node.cpt;
             std::vector<int> parents = getParents(node.id);
+            size_t num_parents = std::min(parents.size(), cpt.parent_cards.size());
+            states.assign(cpt.parent_cards.size(), 0);
             std::cout << "  CPT for Node " << node.id << " (" << node.name << "):\n";
-            for (const auto& entry : node.cpt) {
+            for (size_t r = 0; r < cpt.numRows(); r++) {
+                // Rows are walked in order, so the parent states count up
+                if (r > 0) {
+                    for (int p = (int)states.size() - 1; p >= 0; p--) {
+                        if (++states[p] < cpt.parent_cards[p]) break;
+                        states[p] = 0;
+                    }
+                }
+                if (!cpt.row_set[r]) continue;
                 std::cout << "    P(" << node.name;
-                if (!parents.empty()) {
+                if (num_parents > 0) {
                     std::cout << " | ";
-                    for (size_t i = 0; i < parents.size(); i++) {
+                    for (size_t i = 0; i < num_parents; i++) {
                         const Node* parent = getNode(parents[i]);
                         if (parent) {
-                            std::cout << parent->name << "=" << entry.first[i];
-                            if (i < parents.size() - 1) std::cout << ", ";
+                            std::cout << parent->name << "=" << states[i];
+                            if (i < num_parents - 1) std::cout << ", ";
                         }
                     }
                 }
                 std::cout << ") = [";
-                for (size_t i = 0; i < entry.second.size(); i++) {
-                    std::cout << entry.second[i];
-                    if (i < entry.second.size() - 1) std::cout << ", ";
+                const double* row = cpt.row(r);
+                for (int i = 0; i < cpt.num_states; i++) {
+                    std::cout << row[i];
+                    if (i < cpt.num_states - 1) std::cout << ", ";
                 }
                 std::cout << "]\n";
             }
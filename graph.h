@@ -1,10 +1,13 @@
 #ifndef GRAPH_H
 #define GRAPH_H
 
+#include "arena.h"
 #include <vector>
 #include <string>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <cstdint>
 
 // Forward declarations
 class Node;
@@ -16,6 +19,33 @@ enum class GraphType {
     UNDIRECTED
 };
 
+// Dense CPT (Conditional Probability Table) for Bayesian Networks.
+// Row r is a parent state combination in mixed radix (first parent most
+// significant, in parent declaration order) and holds the distribution over
+// the node's states at probs[r * num_states]. Rows that were never set keep
+// 1.0 entries, i.e. they do not constrain the model.
+class DenseCPT {
+public:
+    int num_states;
+    std::vector<int> parent_cards;  // Cardinality of each parent
+    std::vector<size_t> strides;    // Stride of each parent in probs (node stride is 1)
+    std::vector<double> probs;
+    std::vector<bool> row_set;      // Rows given explicitly
+    
+    DenseCPT();
+    
+    // Allocate an all-ones table for the given shape
+    void reset(int num_states, const std::vector<int>& parent_cards);
+    bool empty() const { return probs.empty(); }
+    size_t numRows() const { return row_set.size(); }
+    bool hasShape(int num_states, const std::vector<int>& parent_cards) const;
+    // Row of a parent state combination, false if out of range
+    bool rowIndex(const std::vector<int>& parent_states, size_t& row) const;
+    // Copy up to num_states probabilities into a row
+    void setRow(size_t row, const double* values, size_t count);
+    const double* row(size_t r) const { return probs.data() + r * num_states; }
+};
+
 // Node in the graphical model
 class Node {
 public:
@@ -24,15 +54,14 @@ public:
     int num_states;
     std::vector<double> potential;  // For undirected graphs or node potentials
     
-    // CPT (Conditional Probability Table) for Bayesian Networks
-    // Format: map from parent state combination to probability distribution
-    // Key: vector of parent states (empty for root nodes)
-    // Value: probability distribution over node states
-    std::map<std::vector<int>, std::vector<double>> cpt;
+    DenseCPT cpt;
     bool has_cpt;  // Flag to indicate if CPT is set
     
     Node(int id, const std::string& name, int num_states = 2);
-    void setCPT(const std::map<std::vector<int>, std::vector<double>>& cpt_table);
+    // Map form: key is the parent state combination (empty for root nodes),
+    // value the distribution over node states. Replaces any existing table.
+    void setCPT(const std::map<std::vector<int>, std::vector<double>>& cpt_table,
+                const std::vector<int>& parent_cards);
 };
 
 // Edge in the graphical model
@@ -47,30 +76,129 @@ public:
     void setPotential(const std::vector<std::vector<double>>& pot);
 };
 
+// Maps node ids to positions. Small non-negative ids go through a dense
+// table; negative or very large ids fall back to a hash map so that a few
+// outliers cannot blow up memory.
+class IdIndex {
+public:
+    IdIndex();
+    
+    void insert(int id, int pos);  // Keeps an existing mapping for id
+    int find(int id) const;        // -1 if id is not present
+    size_t size() const { return count; }
+    void clear();
+
+private:
+    std::vector<int> dense;
+    std::unordered_map<int, int> sparse;
+    size_t count;
+};
+
+// Frozen adjacency in compressed sparse row form. Vertices are addressed by
+// local index (their position in the owning model's node list, followed by
+// any ids that only appear in edges); each neighbor list is sorted.
+class CSRAdjacency {
+public:
+    std::vector<int> vertex_ids;   // Local index -> node id
+    std::vector<size_t> offsets;   // Neighbors of v are [offsets[v], offsets[v+1])
+    std::vector<int> neighbors;    // Concatenated neighbor lists (local indices)
+    
+    void build(const std::vector<int>& ids, const AdjacencyMap& adjacency);
+    // Adopt prebuilt arrays (offsets has num_vertices + 1 entries)
+    void assign(const int* ids, size_t num_vertices, const uint64_t* offsets, const int* neighbors);
+    void clear();
+    
+    size_t numVertices() const { return vertex_ids.size(); }
+    size_t numEntries() const { return neighbors.size(); }
+    int indexOf(int id) const { return id_index.find(id); }
+    const int* neighborsBegin(int v) const { return neighbors.data() + offsets[v]; }
+    const int* neighborsEnd(int v) const { return neighbors.data() + offsets[v + 1]; }
+    int degree(int v) const { return (int)(offsets[v + 1] - offsets[v]); }
+    bool hasEdge(int u, int v) const;  // Local indices, binary search
+    
+    // Expand back into the mutable map-of-sets form
+    AdjacencyMap toAdjacencyList() const;
+    // Undirected view: u~v if either direction is stored, self-loops dropped
+    CSRAdjacency symmetrized() const;
+
+private:
+    IdIndex id_index;
+};
+
 // Graphical Model representation
 class GraphicalModel {
 public:
     GraphType type;
     std::vector<Node> nodes;
     std::vector<Edge> edges;
-    std::map<int, std::set<int>> adjacency_list;
+    // Mutable adjacency. Released while the model is frozen, in which case
+    // csr is authoritative; any mutation thaws the model again.
+    AdjacencyMap adjacency_list;
+    CSRAdjacency csr;
     
     GraphicalModel(GraphType t = GraphType::UNDIRECTED);
     
     void addNode(int id, const std::string& name, int num_states = 2);
     void addEdge(int from, int to, bool directed = true);
+    // Pre-size node, edge and edge-index storage for bulk loading
+    void reserve(size_t num_nodes, size_t num_edges);
     void setNodePotential(int node_id, const std::vector<double>& potential);
     void setEdgePotential(int from, int to, const std::vector<std::vector<double>>& potential);
     void setCPT(int node_id, const std::map<std::vector<int>, std::vector<double>>& cpt_table);
+    // Bulk load of CPT entries, each given as [parent states..., probabilities...]
+    // with parents in declaration order. Rows merge into an existing table of
+    // the same shape, so a CPT may be spread over several calls.
+    bool loadCPTRows(int node_id, const std::vector<double>& entries);
+    bool loadCPTRows(int node_id, const double* entries, size_t count);
+    // Cardinalities of a node's parents in declaration order
+    std::vector<int> getParentCards(int node_id) const;
     
     Node* getNode(int id);
     const Node* getNode(int id) const;
     Edge* getEdge(int from, int to);
+    const Edge* getEdge(int from, int to) const;
     std::vector<int> getNeighbors(int node_id) const;
     std::vector<int> getParents(int node_id) const;  // Get parents of a node (for directed graphs)
+    std::vector<int> getChildren(int node_id) const;
+    // Zero-copy views into the family index, in edge declaration order
+    std::pair<const int*, const int*> parentRange(int node_id) const;
+    std::pair<const int*, const int*> childRange(int node_id) const;
     bool hasEdge(int from, int to) const;
     
+    // Rebuild the id lookup tables and adjacency after nodes/edges were
+    // modified directly (leaves the model thawed)
+    void rebuildIndices();
+    // Index nodes/edges that were filled in directly and take a prebuilt
+    // adjacency as the frozen form, skipping the map-of-sets entirely
+    void restoreFrozen(CSRAdjacency&& adjacency);
+    
+    // Switch adjacency to the compact CSR form once the structure is final
+    void freezeAdjacency();
+    bool isFrozen() const { return frozen; }
+    // CSR view of the current adjacency, building a temporary one if needed
+    CSRAdjacency buildAdjacency() const;
+    
     void print() const;
+
+private:
+    IdIndex node_index;  // Node id -> position in nodes
+    // Packed (from, to) -> position of the first matching edge in edges.
+    // Undirected edges are registered under both orientations.
+    std::unordered_map<uint64_t, size_t> edge_index;
+    bool frozen;
+    
+    // Parent/child lists of directed edges in CSR form, indexed by node
+    // position. Built lazily in one pass over edges and dropped whenever a
+    // node or directed edge is added.
+    mutable bool family_valid;
+    mutable std::vector<size_t> parent_offsets;
+    mutable std::vector<int> parent_ids;
+    mutable std::vector<size_t> child_offsets;
+    mutable std::vector<int> child_ids;
+    
+    void indexEdge(size_t pos);
+    void thawAdjacency();
+    void buildFamilyIndex() const;
 };
 
 #endif // GRAPH_H
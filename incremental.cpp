@@ -0,0 +1,413 @@
+#include "incremental.h"
+#include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <map>
+#include <utility>
+#include <iterator>
+
+IncrementalStats::IncrementalStats()
+    : changed_factors(0), changed_moral_edges(0), touched_vertices(0), cliques(0),
+      recomputed_cliques(0), reused_gates(0), total_gates(0) {
+}
+
+void IncrementalStats::print() const {
+    std::cout << "Incremental recompilation\n";
+    std::cout << "  Changed factors: " << changed_factors << "\n";
+    std::cout << "  Changed moral edges: " << changed_moral_edges << " (" << touched_vertices
+              << " vertices touched)\n";
+    std::cout << "  Recomputed cliques: " << recomputed_cliques << " of " << cliques << "\n";
+    std::cout << "  Reused gates: " << reused_gates << " of " << total_gates << "\n";
+}
+
+// Position of a node id in gm.nodes, -1 if undeclared
+static int positionOf(const GraphicalModel& gm, int id) {
+    const Node* node = gm.getNode(id);
+    return node ? (int)(node - gm.nodes.data()) : -1;
+}
+
+static inline uint64_t packPair(int u, int v) {
+    if (u > v) std::swap(u, v);
+    return ((uint64_t)(uint32_t)u << 32) | (uint32_t)v;
+}
+
+// Moral-graph edges as packed (low, high) node positions, sorted. False if
+// the moral graph would have a self-loop or a vertex that is not a node;
+// the clique search treats those specially, so they take the full path.
+static bool moralEdges(const GraphicalModel& gm, std::vector<uint64_t>& pairs) {
+    pairs.clear();
+    pairs.reserve(gm.edges.size());
+    for (const auto& edge : gm.edges) {
+        int u = positionOf(gm, edge.from);
+        int v = positionOf(gm, edge.to);
+        if (u < 0 || v < 0 || u == v) {
+            return false;
+        }
+        pairs.push_back(packPair(u, v));
+    }
+    if (gm.type == GraphType::DIRECTED) {
+        std::vector<int> parents;
+        for (const auto& node : gm.nodes) {
+            std::pair<const int*, const int*> range = gm.parentRange(node.id);
+            parents.clear();
+            for (const int* p = range.first; p != range.second; ++p) {
+                parents.push_back(positionOf(gm, *p));
+            }
+            for (size_t i = 0; i < parents.size(); i++) {
+                for (size_t j = i + 1; j < parents.size(); j++) {
+                    if (parents[i] == parents[j]) {
+                        return false;
+                    }
+                    pairs.push_back(packPair(parents[i], parents[j]));
+                }
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+    return true;
+}
+
+// CSR over node positions from sorted moral pairs. Walking the pairs in
+// order hands every vertex its lower neighbors first, each group ascending,
+// so the lists come out sorted.
+static CSRAdjacency moralAdjacency(const GraphicalModel& gm, const std::vector<uint64_t>& pairs) {
+    size_t n = gm.nodes.size();
+    std::vector<int> ids(n);
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = gm.nodes[i].id;
+    }
+    std::vector<uint64_t> offsets(n + 1, 0);
+    for (uint64_t pair : pairs) {
+        offsets[(pair >> 32) + 1]++;
+        offsets[(uint32_t)pair + 1]++;
+    }
+    for (size_t v = 0; v < n; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<int> neighbors(offsets[n]);
+    std::vector<uint64_t> fill(offsets.begin(), offsets.end() - 1);
+    for (uint64_t pair : pairs) {
+        int u = (int)(pair >> 32);
+        int v = (int)(uint32_t)pair;
+        neighbors[fill[u]++] = v;
+        neighbors[fill[v]++] = u;
+    }
+    CSRAdjacency adjacency;
+    adjacency.assign(ids.data(), n, offsets.data(), neighbors.data());
+    return adjacency;
+}
+
+// Identity of a factor across two versions of a model: node factors by
+// node position, edge factors by (from, to) and occurrence among edges with
+// the same endpoints
+class FactorRef {
+public:
+    bool is_edge;
+    int first;       // Node position, or edge from
+    int second;      // Edge to
+    int occurrence;
+
+    bool operator==(const FactorRef& other) const {
+        return is_edge == other.is_edge && first == other.first && second == other.second &&
+               occurrence == other.occurrence;
+    }
+    bool operator!=(const FactorRef& other) const { return !(*this == other); }
+};
+
+// Factors of one model version in convertToMRF's multiplication order
+// (nodes, then edges) and the clique each one lands in
+class FactorAssignment {
+public:
+    std::vector<FactorRef> refs;
+    std::vector<size_t> sources;  // Node position or edge index
+    std::vector<int> cliques;     // -1 if no clique covers the scope
+
+    void build(const GraphicalModel& gm, const std::vector<const std::vector<int>*>& clique_vars);
+};
+
+void FactorAssignment::build(const GraphicalModel& gm,
+                             const std::vector<const std::vector<int>*>& clique_vars) {
+    std::vector<std::vector<int>> member_of(gm.nodes.size());
+    for (size_t c = 0; c < clique_vars.size(); c++) {
+        for (int id : *clique_vars[c]) {
+            int v = positionOf(gm, id);
+            if (v >= 0) member_of[v].push_back((int)c);
+        }
+    }
+    // First clique (lowest index) containing the whole scope, as in
+    // convertToMRF
+    auto containing = [&](const std::vector<int>& scope) {
+        int v = positionOf(gm, scope[0]);
+        if (v < 0) return -1;
+        for (int c : member_of[v]) {
+            const std::vector<int>& vars = *clique_vars[c];
+            bool contains = true;
+            for (size_t i = 1; i < scope.size() && contains; i++) {
+                contains = std::binary_search(vars.begin(), vars.end(), scope[i]);
+            }
+            if (contains) return c;
+        }
+        return -1;
+    };
+
+    for (size_t i = 0; i < gm.nodes.size(); i++) {
+        FactorRef ref = {false, (int)i, 0, 0};
+        refs.push_back(ref);
+        sources.push_back(i);
+        cliques.push_back(containing(nodeFactorScope(gm.nodes[i], gm)));
+    }
+    std::unordered_map<uint64_t, int> seen;
+    for (size_t e = 0; e < gm.edges.size(); e++) {
+        const Edge& edge = gm.edges[e];
+        if (!hasEdgeFactor(edge)) continue;
+        uint64_t key = ((uint64_t)(uint32_t)edge.from << 32) | (uint32_t)edge.to;
+        FactorRef ref = {true, edge.from, edge.to, seen[key]++};
+        refs.push_back(ref);
+        sources.push_back(e);
+        cliques.push_back(containing({edge.from, edge.to}));
+    }
+}
+
+static bool sameCPT(const DenseCPT& a, const DenseCPT& b) {
+    return a.num_states == b.num_states && a.parent_cards == b.parent_cards && a.probs == b.probs &&
+           a.row_set == b.row_set;
+}
+
+bool recompileIncremental(const GraphicalModel& prev_gm, const MRF& prev_mrf,
+                          const QPUCircuit& prev_circuit, const GraphicalModel& gm,
+                          MRF& mrf, QPUCircuit& circuit, IncrementalStats& stats) {
+    // Qubits are node positions, so the node list must line up
+    size_t n = gm.nodes.size();
+    if (prev_gm.type != gm.type || prev_gm.nodes.size() != n || prev_mrf.nodes.size() != n) {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (prev_gm.nodes[i].id != gm.nodes[i].id ||
+            prev_gm.nodes[i].num_states != gm.nodes[i].num_states ||
+            positionOf(gm, gm.nodes[i].id) != (int)i || positionOf(prev_gm, gm.nodes[i].id) != (int)i) {
+            return false;
+        }
+    }
+    const std::vector<size_t>& prev_offsets = prev_circuit.clique_gate_offsets;
+    if (prev_circuit.num_qubits != (int)n || prev_offsets.size() != prev_mrf.cliques.size() + 1 ||
+        prev_offsets.front() != n || prev_offsets.back() + n != prev_circuit.gates.size()) {
+        return false;
+    }
+
+    // 1. Moral-graph diff and the cliques through touched vertices
+    std::vector<uint64_t> prev_pairs;
+    std::vector<uint64_t> pairs;
+    if (!moralEdges(prev_gm, prev_pairs) || !moralEdges(gm, pairs)) {
+        return false;
+    }
+    std::vector<uint64_t> changed;
+    std::set_symmetric_difference(prev_pairs.begin(), prev_pairs.end(), pairs.begin(), pairs.end(),
+                                  std::back_inserter(changed));
+    std::vector<char> touched(n, 0);
+    std::vector<int> touched_list;
+    for (uint64_t pair : changed) {
+        int ends[2] = {(int)(pair >> 32), (int)(uint32_t)pair};
+        for (int v : ends) {
+            if (!touched[v]) {
+                touched[v] = 1;
+                touched_list.push_back(v);
+            }
+        }
+    }
+    std::sort(touched_list.begin(), touched_list.end());
+    stats.changed_moral_edges = changed.size();
+    stats.touched_vertices = touched_list.size();
+
+    CSRAdjacency adjacency = moralAdjacency(gm, pairs);
+    std::vector<std::vector<int>> found = findMaximalCliquesContaining(adjacency, touched_list);
+    // Cliques too large for a table are split into pairs by the full path,
+    // so a new one takes it, and so does an old pair a new clique now covers
+    std::vector<std::vector<int>> found_at(n);  // Node position -> found cliques
+    for (size_t c = 0; c < found.size(); c++) {
+        if (!cliqueTableFits(found[c], gm)) {
+            return false;
+        }
+        for (int id : found[c]) {
+            found_at[positionOf(gm, id)].push_back((int)c);
+        }
+    }
+
+    // Old cliques without touched vertices survive as they are; the sorted
+    // merge with the new ones gives findMaximalCliques' order
+    std::vector<int> prev_index;      // Old clique of each new clique, -1 if none
+    std::vector<const std::vector<int>*> clique_vars;
+    std::map<std::vector<int>, int> dropped;
+    size_t next_found = 0;
+    for (size_t j = 0; j <= prev_mrf.cliques.size(); j++) {
+        bool kept = false;
+        if (j < prev_mrf.cliques.size()) {
+            kept = true;
+            for (int id : prev_mrf.cliques[j].vars) {
+                int v = positionOf(gm, id);
+                if (v < 0 || touched[v]) {
+                    kept = false;
+                    break;
+                }
+            }
+            if (!kept) {
+                dropped[prev_mrf.cliques[j].vars] = (int)j;
+                continue;
+            }
+            const std::vector<int>& vars = prev_mrf.cliques[j].vars;
+            if (vars.size() == 2) {
+                for (int c : found_at[positionOf(gm, vars[0])]) {
+                    if (std::binary_search(found[c].begin(), found[c].end(), vars[1])) {
+                        return false;
+                    }
+                }
+            }
+        }
+        while (next_found < found.size() &&
+               (j == prev_mrf.cliques.size() || found[next_found] < prev_mrf.cliques[j].vars)) {
+            clique_vars.push_back(&found[next_found++]);
+            prev_index.push_back(-1);
+        }
+        if (kept) {
+            clique_vars.push_back(&prev_mrf.cliques[j].vars);
+            prev_index.push_back((int)j);
+        }
+    }
+    // A re-enumerated clique may still match an old one exactly
+    for (size_t c = 0; c < clique_vars.size(); c++) {
+        if (prev_index[c] < 0) {
+            auto it = dropped.find(*clique_vars[c]);
+            if (it != dropped.end()) prev_index[c] = it->second;
+        }
+    }
+
+    // 2. Factor assignment in both versions and the factors whose values
+    // changed
+    std::vector<const std::vector<int>*> prev_clique_vars;
+    for (const auto& clique : prev_mrf.cliques) {
+        prev_clique_vars.push_back(&clique.vars);
+    }
+    FactorAssignment prev_factors;
+    FactorAssignment factors;
+    prev_factors.build(prev_gm, prev_clique_vars);
+    factors.build(gm, clique_vars);
+
+    std::unordered_map<uint64_t, std::vector<size_t>> prev_edges;  // (from, to) -> edge indices
+    for (size_t f = 0; f < prev_factors.refs.size(); f++) {
+        const FactorRef& ref = prev_factors.refs[f];
+        if (ref.is_edge) {
+            uint64_t key = ((uint64_t)(uint32_t)ref.first << 32) | (uint32_t)ref.second;
+            prev_edges[key].push_back(prev_factors.sources[f]);
+        }
+    }
+    std::vector<char> dirty(factors.refs.size(), 0);
+    size_t matched_edges = 0;
+    size_t prev_edge_factors = prev_factors.refs.size() - n;
+    for (size_t f = 0; f < factors.refs.size(); f++) {
+        const FactorRef& ref = factors.refs[f];
+        if (!ref.is_edge) {
+            const Node& node = gm.nodes[ref.first];
+            const Node& prev = prev_gm.nodes[ref.first];
+            dirty[f] = node.potential != prev.potential || node.has_cpt != prev.has_cpt ||
+                       !sameCPT(node.cpt, prev.cpt) ||
+                       nodeFactorScope(node, gm) != nodeFactorScope(prev, prev_gm);
+        } else {
+            uint64_t key = ((uint64_t)(uint32_t)ref.first << 32) | (uint32_t)ref.second;
+            auto it = prev_edges.find(key);
+            if (it == prev_edges.end() || ref.occurrence >= (int)it->second.size()) {
+                dirty[f] = 1;
+                continue;
+            }
+            matched_edges++;
+            dirty[f] = gm.edges[factors.sources[f]].potential !=
+                       prev_gm.edges[it->second[ref.occurrence]].potential;
+        }
+        stats.changed_factors += dirty[f];
+    }
+    stats.changed_factors += prev_edge_factors - matched_edges;
+
+    std::vector<std::vector<size_t>> assigned(clique_vars.size());
+    std::vector<std::vector<size_t>> prev_assigned(prev_mrf.cliques.size());
+    for (size_t f = 0; f < factors.refs.size(); f++) {
+        if (factors.cliques[f] >= 0) assigned[factors.cliques[f]].push_back(f);
+    }
+    for (size_t f = 0; f < prev_factors.refs.size(); f++) {
+        if (prev_factors.cliques[f] >= 0) prev_assigned[prev_factors.cliques[f]].push_back(f);
+    }
+
+    // A clique is unchanged if it existed before with the same factors, in
+    // the same order, none of which changed
+    std::vector<char> reuse(clique_vars.size(), 0);
+    for (size_t c = 0; c < clique_vars.size(); c++) {
+        int j = prev_index[c];
+        if (j < 0 || assigned[c].size() != prev_assigned[j].size()) continue;
+        bool same = true;
+        for (size_t k = 0; k < assigned[c].size() && same; k++) {
+            size_t f = assigned[c][k];
+            same = !dirty[f] && factors.refs[f] == prev_factors.refs[prev_assigned[j][k]];
+        }
+        reuse[c] = same;
+    }
+
+    // Build the MRF: reused potentials are copied, the rest multiplied
+    // together exactly as convertToMRF does
+    MRF result;
+    result.nodes.reserve(n);
+    for (const auto& node : gm.nodes) {
+        result.nodes.emplace_back(node.id, node.name, node.num_states);
+    }
+    result.cliques.reserve(clique_vars.size());
+    std::vector<int> cards;
+    for (size_t c = 0; c < clique_vars.size(); c++) {
+        const std::vector<int>& vars = *clique_vars[c];
+        cards.clear();
+        for (int id : vars) {
+            cards.push_back(gm.getNode(id)->num_states);
+        }
+        result.cliques.emplace_back(vars, cards);
+        Clique& clique = result.cliques.back();
+        if (reuse[c]) {
+            clique.values = prev_mrf.cliques[prev_index[c]].values;
+            continue;
+        }
+        stats.recomputed_cliques++;
+        for (size_t f : assigned[c]) {
+            if (factors.refs[f].is_edge) {
+                multiplyEdgeFactor(clique, gm.edges[factors.sources[f]]);
+            } else {
+                multiplyNodeFactor(clique, gm.nodes[factors.sources[f]], gm);
+            }
+        }
+    }
+    result.restoreFrozen(std::move(adjacency));
+    stats.cliques = result.cliques.size();
+
+    // 3. Patch the gate list: same prologue and measurements, clique spans
+    // copied where the potential was reused
+    QPUCircuit patched((int)n);
+    patched.gates.reserve(prev_circuit.gates.size());
+    for (size_t i = 0; i < n; i++) {
+        patched.addGate(GateType::H, i);
+    }
+    for (size_t c = 0; c < result.cliques.size(); c++) {
+        patched.clique_gate_offsets.push_back(patched.gates.size());
+        if (reuse[c]) {
+            size_t begin = prev_offsets[prev_index[c]];
+            size_t end = prev_offsets[prev_index[c] + 1];
+            patched.gates.insert(patched.gates.end(), prev_circuit.gates.begin() + begin,
+                                 prev_circuit.gates.begin() + end);
+            stats.reused_gates += end - begin;
+        } else {
+            encodeCliquePotential(result.cliques[c], patched, result.csr);
+        }
+    }
+    patched.clique_gate_offsets.push_back(patched.gates.size());
+    for (size_t i = 0; i < n; i++) {
+        patched.addMeasurement(i);
+    }
+    stats.total_gates = patched.gates.size();
+
+    mrf = std::move(result);
+    circuit = std::move(patched);
+    return true;
+}
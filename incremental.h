@@ -0,0 +1,46 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "graph.h"
+#include "mrf.h"
+#include "qpu_circuit.h"
+#include <cstddef>
+
+// What an incremental recompilation found and redid
+class IncrementalStats {
+public:
+    size_t changed_factors;      // Node/edge factors added, removed or changed
+    size_t changed_moral_edges;  // Moral-graph edges added or removed
+    size_t touched_vertices;     // Endpoints of those edges
+    size_t cliques;              // Cliques of the new MRF
+    size_t recomputed_cliques;   // Potentials rebuilt from their factors
+    size_t reused_gates;         // Gates copied from the previous circuit
+    size_t total_gates;
+
+    IncrementalStats();
+    void print() const;
+};
+
+// Recompile gm against a previous compilation (prev_gm -> prev_mrf ->
+// prev_circuit) by redoing only what the edit can reach:
+//
+//   1. Diff the moral graphs; the endpoints of added/removed moral edges
+//      are the touched vertices. A clique without touched vertices keeps
+//      its maximality, so only cliques through touched vertices are
+//      enumerated again.
+//   2. Reassign node and edge factors to cliques; a clique whose factors
+//      (or their values) are unchanged keeps its old potential, the others
+//      are rebuilt.
+//   3. Copy the gate span of every unchanged clique from prev_circuit and
+//      encode the rest.
+//
+// The result is identical to convertToMRF + convertMRFToQPU on gm. Returns
+// false, leaving mrf and circuit untouched, when the edit needs a full
+// compilation: nodes added, removed, reordered or resized, the graph type
+// changed, edges to undeclared nodes or self-loops, or a previous circuit
+// without clique gate offsets.
+bool recompileIncremental(const GraphicalModel& prev_gm, const MRF& prev_mrf,
+                          const QPUCircuit& prev_circuit, const GraphicalModel& gm,
+                          MRF& mrf, QPUCircuit& circuit, IncrementalStats& stats);
+
+#endif // INCREMENTAL_H
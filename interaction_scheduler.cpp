@@ -0,0 +1,314 @@
+#include "interaction_scheduler.h"
+#include "circuit_optimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+ScheduleStats::ScheduleStats()
+    : scheduled(false), hoisted(false), depth_before(0), depth_after(0), interactions(0), merged(0),
+      runs(0), max_degree(0), layers(0) {
+}
+
+void ScheduleStats::print() const {
+    if (!scheduled) {
+        std::cout << "Interaction scheduling: circuit is not a clique-ordered Ising encoding, left as is\n";
+        return;
+    }
+    std::cout << "Interaction scheduling" << (hoisted ? " (fields hoisted, approximate)" : "") << ": depth "
+              << depth_before << " -> " << depth_after << "\n";
+    std::cout << "  Interactions: " << interactions << " (" << merged << " repeated couplings merged)\n";
+    std::cout << "  Layers: " << layers << " in " << runs << " runs between fields (max degree in a run "
+              << max_degree << ")\n";
+}
+
+// One ZZ coupling between control and target, in run stage
+struct Coupling {
+    int control;
+    int target;
+    double angle;
+    size_t stage;
+};
+
+// A local field RY on qubit, applied after the couplings of run stage
+struct Field {
+    int qubit;
+    double angle;
+    size_t stage;
+};
+
+// Colors in use at one vertex, one bit each
+class ColorSet {
+public:
+    std::vector<uint64_t> words;
+
+    void set(size_t color) {
+        if (color / 64 >= words.size()) {
+            words.resize(color / 64 + 1, 0);
+        }
+        words[color / 64] |= uint64_t(1) << (color % 64);
+    }
+};
+
+// Smallest color free in both a and b
+static size_t firstFreeColor(const ColorSet& a, const ColorSet& b) {
+    size_t n = std::max(a.words.size(), b.words.size());
+    for (size_t w = 0; w < n; w++) {
+        uint64_t used = (w < a.words.size() ? a.words[w] : 0) | (w < b.words.size() ? b.words[w] : 0);
+        if (~used != 0) {
+            return w * 64 + __builtin_ctzll(~used);
+        }
+    }
+    return n * 64;
+}
+
+// Color of every edge such that edges sharing a vertex differ; returns the
+// number of colors
+static size_t colorEdges(const std::vector<Coupling>& edges, int num_vertices, std::vector<size_t>& color,
+                         size_t& max_degree) {
+    std::vector<size_t> degree(num_vertices, 0);
+    for (const Coupling& e : edges) {
+        degree[e.control]++;
+        degree[e.target]++;
+    }
+    max_degree = 0;
+    for (size_t d : degree) {
+        max_degree = std::max(max_degree, d);
+    }
+    // Incident edges per vertex (CSR)
+    std::vector<size_t> offsets(num_vertices + 1, 0);
+    for (int v = 0; v < num_vertices; v++) {
+        offsets[v + 1] = offsets[v] + degree[v];
+    }
+    std::vector<size_t> incident(offsets.back());
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t e = 0; e < edges.size(); e++) {
+        incident[fill[edges[e].control]++] = e;
+        incident[fill[edges[e].target]++] = e;
+    }
+    // Highest degree first (counting sort), so the busiest vertices get the
+    // low colors before their neighbours use them up
+    std::vector<size_t> by_degree(max_degree + 2, 0);
+    for (size_t d : degree) {
+        by_degree[max_degree - d + 1]++;
+    }
+    for (size_t k = 1; k < by_degree.size(); k++) {
+        by_degree[k] += by_degree[k - 1];
+    }
+    std::vector<int> order(num_vertices);
+    for (int v = 0; v < num_vertices; v++) {
+        order[by_degree[max_degree - degree[v]]++] = v;
+    }
+
+    const size_t NONE = (size_t)-1;
+    color.assign(edges.size(), NONE);
+    std::vector<ColorSet> used(num_vertices);
+    size_t colors = 0;
+    for (int u : order) {
+        for (size_t k = offsets[u]; k < offsets[u + 1]; k++) {
+            size_t e = incident[k];
+            if (color[e] != NONE) {
+                continue;
+            }
+            int a = edges[e].control;
+            int b = edges[e].target;
+            size_t c = firstFreeColor(used[a], used[b]);
+            color[e] = c;
+            used[a].set(c);
+            used[b].set(c);
+            colors = std::max(colors, c + 1);
+        }
+    }
+    return colors;
+}
+
+// Color one run's couplings, numbering its qubits locally so a run costs
+// its own size rather than the circuit's width; local is all -1 on entry and
+// on return
+static size_t colorRun(const std::vector<Coupling>& run, std::vector<int>& local, std::vector<size_t>& color,
+                       size_t& max_degree) {
+    std::vector<int> qubits;
+    std::vector<Coupling> edges(run);
+    for (Coupling& e : edges) {
+        for (int* q : {&e.control, &e.target}) {
+            if (local[*q] < 0) {
+                local[*q] = (int)qubits.size();
+                qubits.push_back(*q);
+            }
+            *q = local[*q];
+        }
+    }
+    size_t colors = colorEdges(edges, (int)qubits.size(), color, max_degree);
+    for (int q : qubits) {
+        local[q] = -1;
+    }
+    return colors;
+}
+
+ScheduleStats scheduleInteractions(QPUCircuit& circuit, bool hoist_fields) {
+    ScheduleStats stats;
+    stats.hoisted = hoist_fields;
+    stats.depth_before = circuit.depth();
+    stats.depth_after = stats.depth_before;
+    const std::vector<size_t>& offsets = circuit.clique_gate_offsets;
+    if (offsets.empty() || offsets.back() > circuit.gates.size() ||
+        !std::is_sorted(offsets.begin(), offsets.end())) {
+        return stats;
+    }
+    size_t begin = offsets.front();
+    size_t end = offsets.back();
+    int n = circuit.num_qubits;
+
+    // Stage s is a run of couplings followed by fields. A coupling goes to
+    // the first run after the last field on its qubits, a field to the
+    // stage of the last coupling on its qubit (and not before the qubit's
+    // previous field), so everything keeps its order against the gates it
+    // does not commute with. Hoisted, all fields go first and all couplings
+    // form one run.
+    std::vector<size_t> coupling_stage(n > 0 ? n : 0, 0);  // Of the last coupling on the qubit
+    std::vector<size_t> field_stage(n > 0 ? n : 0, 0);     // Of the last field on the qubit
+    std::vector<char> has_field(n > 0 ? n : 0, 0);
+    std::vector<Field> fields;
+    std::vector<Coupling> couplings;
+    auto addCoupling = [&](int control, int target, double angle) {
+        size_t stage = 0;
+        if (!hoist_fields) {
+            for (int q : {control, target}) {
+                if (has_field[q]) {
+                    stage = std::max(stage, field_stage[q] + 1);
+                }
+            }
+            coupling_stage[control] = std::max(coupling_stage[control], stage);
+            coupling_stage[target] = std::max(coupling_stage[target], stage);
+        }
+        couplings.push_back(Coupling{control, target, angle, stage});
+    };
+    for (size_t g = begin; g < end; g++) {
+        const QuantumGate& gate = circuit.gates[g];
+        if (gate.target_qubit < 0 || gate.target_qubit >= n ||
+            (gate.control_qubit >= n || (gate.control_qubit >= 0 && gate.control_qubit == gate.target_qubit))) {
+            return stats;
+        }
+        if (gate.type == GateType::RY && gate.control_qubit < 0) {
+            int q = gate.target_qubit;
+            size_t stage = hoist_fields ? 0 : std::max(coupling_stage[q], field_stage[q]);
+            field_stage[q] = stage;
+            has_field[q] = 1;
+            fields.push_back(Field{q, gate.parameter, stage});
+        } else if (gate.type == GateType::RZZ && gate.control_qubit >= 0) {
+            addCoupling(gate.control_qubit, gate.target_qubit, gate.parameter);
+        } else if (gate.type == GateType::CNOT && g + 2 < end && gate.control_qubit >= 0 &&
+                   circuit.gates[g + 1].type == GateType::RZ &&
+                   circuit.gates[g + 1].target_qubit == gate.target_qubit &&
+                   circuit.gates[g + 2].type == GateType::CNOT &&
+                   circuit.gates[g + 2].target_qubit == gate.target_qubit &&
+                   circuit.gates[g + 2].control_qubit == gate.control_qubit) {
+            addCoupling(gate.control_qubit, gate.target_qubit, circuit.gates[g + 1].parameter);
+            g += 2;
+        } else {
+            return stats;
+        }
+    }
+
+    // Within a stage, the fields of one qubit and the couplings of one pair
+    // (ZZ is symmetric) have nothing between them that they fail to commute
+    // with, so they add up; the first coupling keeps its orientation
+    std::stable_sort(fields.begin(), fields.end(), [](const Field& x, const Field& y) {
+        return x.stage != y.stage ? x.stage < y.stage : x.qubit < y.qubit;
+    });
+    std::vector<Field> summed;
+    for (const Field& f : fields) {
+        if (!summed.empty() && summed.back().stage == f.stage && summed.back().qubit == f.qubit) {
+            summed.back().angle += f.angle;
+        } else {
+            summed.push_back(f);
+        }
+    }
+    summed.erase(std::remove_if(summed.begin(), summed.end(),
+                                [](const Field& f) { return std::abs(f.angle) < ZERO_ANGLE; }),
+                 summed.end());
+
+    auto key = [](const Coupling& c) {
+        return (uint64_t)std::min(c.control, c.target) << 32 | (uint64_t)std::max(c.control, c.target);
+    };
+    std::stable_sort(couplings.begin(), couplings.end(), [&](const Coupling& x, const Coupling& y) {
+        return x.stage != y.stage ? x.stage < y.stage : key(x) < key(y);
+    });
+    std::vector<Coupling> pairs;
+    pairs.reserve(couplings.size());
+    for (const Coupling& c : couplings) {
+        if (!pairs.empty() && pairs.back().stage == c.stage && key(pairs.back()) == key(c)) {
+            pairs.back().angle += c.angle;
+            stats.merged++;
+        } else {
+            pairs.push_back(c);
+        }
+    }
+    pairs.erase(std::remove_if(pairs.begin(), pairs.end(),
+                               [](const Coupling& c) { return std::abs(c.angle) < ZERO_ANGLE; }),
+                pairs.end());
+    stats.interactions = pairs.size();
+
+    GateList gates;
+    gates.reserve(circuit.gates.size() - (end - begin) + summed.size() + 3 * pairs.size());
+    gates.insert(gates.end(), circuit.gates.begin(), circuit.gates.begin() + begin);
+    size_t next_field = 0;
+    auto emitFields = [&](size_t stage, bool all) {
+        for (; next_field < summed.size() && (all || summed[next_field].stage == stage); next_field++) {
+            gates.emplace_back(GateType::RY, summed[next_field].qubit, -1, summed[next_field].angle);
+        }
+    };
+    if (hoist_fields) {
+        emitFields(0, true);
+    }
+    std::vector<int> local(n > 0 ? n : 0, -1);
+    for (size_t first = 0; first < pairs.size() || next_field < summed.size();) {
+        // One stage: its run of couplings, layer by layer, then its fields
+        size_t stage = first < pairs.size() ? pairs[first].stage : summed[next_field].stage;
+        if (next_field < summed.size()) {
+            stage = std::min(stage, summed[next_field].stage);
+        }
+        size_t last = first;
+        while (last < pairs.size() && pairs[last].stage == stage) {
+            last++;
+        }
+        if (last > first) {
+            std::vector<Coupling> run(pairs.begin() + first, pairs.begin() + last);
+            std::vector<size_t> color;
+            size_t degree = 0;
+            size_t layers = colorRun(run, local, color, degree);
+            stats.layers += layers;
+            stats.runs++;
+            stats.max_degree = std::max(stats.max_degree, degree);
+            // Pairs stay in (control, target) order within a layer
+            std::vector<size_t> layer_start(layers + 1, 0);
+            for (size_t c : color) {
+                layer_start[c + 1]++;
+            }
+            for (size_t k = 0; k < layers; k++) {
+                layer_start[k + 1] += layer_start[k];
+            }
+            std::vector<size_t> layered(run.size());
+            for (size_t e = 0; e < run.size(); e++) {
+                layered[layer_start[color[e]]++] = e;
+            }
+            for (size_t e : layered) {
+                const Coupling& c = run[e];
+                gates.emplace_back(GateType::CNOT, c.target, c.control);
+                gates.emplace_back(GateType::RZ, c.target, -1, c.angle);
+                gates.emplace_back(GateType::CNOT, c.target, c.control);
+            }
+        }
+        emitFields(stage, false);
+        first = last;
+    }
+    gates.insert(gates.end(), circuit.gates.begin() + end, circuit.gates.end());
+    circuit.gates = std::move(gates);
+    circuit.clique_gate_offsets.clear();
+
+    stats.scheduled = true;
+    stats.depth_after = circuit.depth();
+    return stats;
+}
@@ -0,0 +1,47 @@
+#ifndef INTERACTION_SCHEDULER_H
+#define INTERACTION_SCHEDULER_H
+
+#include "qpu_circuit.h"
+#include <cstddef>
+
+// What scheduleInteractions did
+class ScheduleStats {
+public:
+    bool scheduled;       // False if the circuit was left alone
+    bool hoisted;         // Fields were moved ahead of the couplings
+    size_t depth_before;
+    size_t depth_after;
+    size_t interactions;  // Coupled qubit pairs, after merging repeats
+    size_t merged;        // Couplings folded into a pair coupled earlier
+    size_t runs;          // Runs of couplings between fields
+    size_t max_degree;    // Most couplings on one qubit within a run
+    size_t layers;        // Colors of the runs' interaction graphs, summed
+
+    ScheduleStats();
+    void print() const;
+};
+
+// Layer the couplings of an Ising circuit (as built by
+// applyIsingHamiltonian, located through clique_gate_offsets). ZZ couplings
+// (CNOT-RZ-CNOT or RZZ) commute with each other but not with a local field
+// RY on one of their qubits, so each field is a barrier on its qubit: the
+// couplings are split into runs that keep their order against the fields,
+// and each run is emitted in layers of disjoint pairs from an edge coloring
+// of its interaction graph. Within a run, repeated couplings of a pair are
+// merged, and so are the fields of a qubit between runs. The result is the
+// same unitary.
+//
+// With hoist_fields, all fields of a qubit are summed and moved ahead of all
+// the couplings, which form a single run. That is another ordering of the
+// same Hamiltonian terms, not the same unitary: an approximation that buys
+// a much shallower circuit.
+//
+// Edges are colored greedily with the smallest color free at both ends,
+// highest-degree vertices first. That bounds a run's layers by 2 * max
+// degree - 1 rather than Vizing's max degree + 1, but on moral graphs it
+// lands on max degree itself, in time linear in the couplings. Circuits
+// without usable offsets, or with other gates among the clique encodings,
+// are left unchanged. clique_gate_offsets is cleared.
+ScheduleStats scheduleInteractions(QPUCircuit& circuit, bool hoist_fields = false);
+
+#endif // INTERACTION_SCHEDULER_H
@@ -0,0 +1,293 @@
+#include "junction_tree.h"
+#include "factor_ops.h"
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <cstdint>
+
+// JTCluster implementation
+JTCluster::JTCluster(const std::vector<int>& vars, const std::vector<int>& cards)
+    : Factor(vars, cards, 1.0), parent(-1), separator(-1) {
+}
+
+// Sum a cluster table into `out`, where strides[j] is the stride of cluster
+// variable j in out (0 for variables that are summed out)
+static void projectTable(const Factor& cluster, const std::vector<size_t>& strides,
+                         FactorBuffer& out) {
+    std::fill(out.begin(), out.end(), 0.0);
+    stridedSumInto(cluster.values.data(), cluster.cards, strides, out.data());
+}
+
+// Multiply a table over a subset of the cluster variables into the belief
+static void scaleTable(Factor& cluster, const std::vector<size_t>& strides,
+                       const FactorBuffer& factor) {
+    stridedProduct(cluster.values.data(), cluster.cards, strides, factor.data());
+}
+
+// Rescale a table to sum to one; tables that sum to zero are left alone
+static void normalizeTable(FactorBuffer& table) {
+    double sum = tableSum(table.data(), table.size());
+    if (sum > 0.0) {
+        tableScale(table.data(), 1.0 / sum, table.size());
+    }
+}
+
+static int findRoot(std::vector<int>& uf_parent, int x) {
+    while (uf_parent[x] != x) {
+        uf_parent[x] = uf_parent[uf_parent[x]];
+        x = uf_parent[x];
+    }
+    return x;
+}
+
+// JunctionTree implementation
+JunctionTree::JunctionTree() {
+}
+
+bool JunctionTree::build(const MRF& mrf, EliminationHeuristic heuristic, double max_table_entries) {
+    clusters.clear();
+    separators.clear();
+    schedule.clear();
+    node_index.clear();
+    home_cluster.clear();
+
+    // Graph of the MRF: every clique is fully connected
+    GraphicalModel graph(GraphType::UNDIRECTED);
+    for (size_t i = 0; i < mrf.nodes.size(); i++) {
+        graph.addNode(mrf.nodes[i].id, mrf.nodes[i].name, mrf.nodes[i].num_states);
+        node_index.insert(mrf.nodes[i].id, (int)i);
+    }
+    CSRAdjacency adj = mrf.buildAdjacency();
+    for (size_t v = 0; v < adj.numVertices(); v++) {
+        for (const int* it = adj.neighborsBegin(v); it != adj.neighborsEnd(v); ++it) {
+            if ((int)v < *it) {
+                graph.addEdge(adj.vertex_ids[v], adj.vertex_ids[*it], false);
+            }
+        }
+    }
+
+    TriangulationResult triangulation = triangulateGraph(graph, heuristic);
+    if (triangulation.total_table_size > max_table_entries) {
+        std::cerr << "Warning: junction tree needs " << triangulation.total_table_size
+                  << " table entries (treewidth " << triangulation.treewidth
+                  << "), limit is " << max_table_entries << "\n";
+        return false;
+    }
+
+    // One cluster per maximal clique of the chordal graph
+    std::unordered_map<int, std::vector<int>> member_of;
+    for (const auto& vars : triangulation.cliques) {
+        std::vector<int> cards;
+        for (int id : vars) {
+            int pos = node_index.find(id);
+            cards.push_back(pos >= 0 ? mrf.nodes[pos].num_states : 2);
+            member_of[id].push_back((int)clusters.size());
+        }
+        clusters.emplace_back(vars, cards);
+    }
+
+    // Candidate links between clusters sharing a variable, weighted by the
+    // size of the shared set; Kruskal keeps the heaviest spanning forest
+    std::unordered_map<uint64_t, int> shared;
+    for (const auto& entry : member_of) {
+        const std::vector<int>& list = entry.second;
+        for (size_t i = 0; i < list.size(); i++) {
+            for (size_t j = i + 1; j < list.size(); j++) {
+                shared[((uint64_t)list[i] << 32) | (uint32_t)list[j]]++;
+            }
+        }
+    }
+    std::vector<std::pair<int, uint64_t>> candidates;
+    candidates.reserve(shared.size());
+    for (const auto& entry : shared) {
+        candidates.emplace_back(-entry.second, entry.first);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    int num_clusters = (int)clusters.size();
+    std::vector<int> uf_parent(num_clusters);
+    std::iota(uf_parent.begin(), uf_parent.end(), 0);
+    std::vector<std::vector<int>> tree(num_clusters);
+    for (const auto& candidate : candidates) {
+        int a = (int)(candidate.second >> 32);
+        int b = (int)(candidate.second & 0xffffffffu);
+        int ra = findRoot(uf_parent, a);
+        int rb = findRoot(uf_parent, b);
+        if (ra == rb) continue;
+        uf_parent[ra] = rb;
+        tree[a].push_back(b);
+        tree[b].push_back(a);
+    }
+
+    // Orient each tree from its lowest-numbered cluster; BFS order puts
+    // every parent before its children
+    std::vector<char> visited(num_clusters, 0);
+    for (int root = 0; root < num_clusters; root++) {
+        if (visited[root]) continue;
+        visited[root] = 1;
+        size_t head = schedule.size();
+        schedule.push_back(root);
+        while (head < schedule.size()) {
+            int c = schedule[head++];
+            for (int child : tree[c]) {
+                if (visited[child]) continue;
+                visited[child] = 1;
+
+                JTSeparator sep;
+                sep.child = child;
+                sep.parent = c;
+                const JTCluster& lower = clusters[child];
+                std::vector<int> sep_vars;
+                std::vector<int> sep_cards;
+                for (size_t i = 0; i < lower.vars.size(); i++) {
+                    if (std::binary_search(clusters[c].vars.begin(), clusters[c].vars.end(), lower.vars[i])) {
+                        sep_vars.push_back(lower.vars[i]);
+                        sep_cards.push_back(lower.cards[i]);
+                    }
+                }
+                sep.table = Factor(sep_vars, sep_cards);
+                sep.child_strides = lower.linkedStrides(sep.table);
+                sep.parent_strides = clusters[c].linkedStrides(sep.table);
+
+                clusters[child].parent = c;
+                clusters[child].separator = (int)separators.size();
+                separators.push_back(sep);
+                schedule.push_back(child);
+            }
+        }
+    }
+
+    // Multiply each clique potential into a cluster covering it
+    for (const auto& clique : mrf.cliques) {
+        if (clique.vars.empty()) continue;
+        int target = -1;
+        for (int c : member_of[clique.vars[0]]) {
+            const std::vector<int>& vars = clusters[c].vars;
+            bool contains = true;
+            for (size_t i = 1; i < clique.vars.size() && contains; i++) {
+                contains = std::binary_search(vars.begin(), vars.end(), clique.vars[i]);
+            }
+            if (contains) {
+                target = c;
+                break;
+            }
+        }
+        if (target < 0) continue;
+
+        if (!clusters[target].multiply(clique)) {
+            std::cerr << "Warning: skipping clique potential with " << clique.values.size()
+                      << " entries, expected " << clique.tableSize() << "\n";
+        }
+    }
+
+    // Marginals are read from the smallest cluster holding each variable
+    home_cluster.assign(mrf.nodes.size(), -1);
+    for (size_t i = 0; i < mrf.nodes.size(); i++) {
+        auto it = member_of.find(mrf.nodes[i].id);
+        if (it == member_of.end()) continue;
+        for (int c : it->second) {
+            if (home_cluster[i] < 0 || clusters[c].size() < clusters[home_cluster[i]].size()) {
+                home_cluster[i] = c;
+            }
+        }
+    }
+    return true;
+}
+
+// Send the message from a cluster to its parent
+void JunctionTree::collect(int cluster) {
+    JTCluster& child = clusters[cluster];
+    JTSeparator& sep = separators[child.separator];
+    projectTable(child, sep.child_strides, sep.table.values);
+    sep.table.normalize();
+    JTCluster& parent = clusters[child.parent];
+    scaleTable(parent, sep.parent_strides, sep.table.values);
+    parent.normalize();
+}
+
+// Send the message from a cluster's parent back to it, dividing out what
+// the cluster already contributed
+void JunctionTree::distribute(int cluster) {
+    JTCluster& child = clusters[cluster];
+    JTSeparator& sep = separators[child.separator];
+    FactorBuffer& table = sep.table.values;
+    scratch.resize(table.size());
+    projectTable(clusters[child.parent], sep.parent_strides, scratch);
+    normalizeTable(scratch);
+    for (size_t i = 0; i < scratch.size(); i++) {
+        double updated = scratch[i];
+        scratch[i] = table[i] > 0.0 ? updated / table[i] : 0.0;
+        table[i] = updated;
+    }
+    scaleTable(child, sep.child_strides, scratch);
+    child.normalize();
+}
+
+void JunctionTree::calibrate() {
+    for (auto& cluster : clusters) {
+        cluster.normalize();
+    }
+    // Leaves to roots
+    for (int i = (int)schedule.size() - 1; i >= 0; i--) {
+        if (clusters[schedule[i]].parent >= 0) {
+            collect(schedule[i]);
+        }
+    }
+    // Roots to leaves
+    for (size_t i = 0; i < schedule.size(); i++) {
+        if (clusters[schedule[i]].parent >= 0) {
+            distribute(schedule[i]);
+        }
+    }
+}
+
+std::vector<double> JunctionTree::marginal(int node_id) const {
+    int pos = node_index.find(node_id);
+    if (pos < 0 || home_cluster[pos] < 0) {
+        return std::vector<double>();
+    }
+    const JTCluster& cluster = clusters[home_cluster[pos]];
+    Factor single(std::vector<int>(1, node_id),
+                  std::vector<int>(1, cluster.cards[cluster.position(node_id)]));
+    cluster.marginalizeInto(single);
+    single.normalize();
+    return std::vector<double>(single.values.begin(), single.values.end());
+}
+
+int JunctionTree::getTreewidth() const {
+    int treewidth = -1;
+    for (const auto& cluster : clusters) {
+        treewidth = std::max(treewidth, (int)cluster.vars.size() - 1);
+    }
+    return treewidth;
+}
+
+double JunctionTree::getTotalTableSize() const {
+    double total = 0.0;
+    for (const auto& cluster : clusters) {
+        total += (double)cluster.size();
+    }
+    return total;
+}
+
+void JunctionTree::print() const {
+    std::cout << "Junction Tree\n";
+    std::cout << "  Clusters: " << clusters.size() << "\n";
+    std::cout << "  Separators: " << separators.size() << "\n";
+    std::cout << "  Treewidth: " << getTreewidth() << "\n";
+    std::cout << "  Total table size: " << getTotalTableSize() << " entries\n";
+}
+
+void JunctionTree::printMarginals(const MRF& mrf) const {
+    std::cout << "Marginals:\n";
+    for (const auto& node : mrf.nodes) {
+        std::vector<double> p = marginal(node.id);
+        std::cout << "  Node " << node.id << " (" << node.name << "): [";
+        for (size_t i = 0; i < p.size(); i++) {
+            std::cout << p[i];
+            if (i < p.size() - 1) std::cout << ", ";
+        }
+        std::cout << "]\n";
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef JUNCTION_TREE_H
+#define JUNCTION_TREE_H
+
+#include "mrf.h"
+#include <vector>
+#include <string>
+
+// Cluster of a junction tree; its factor values are the belief table
+// (vars sorted by node id)
+class JTCluster : public Factor {
+public:
+    int parent;                  // -1 for the root of each tree
+    int separator;               // Separator to the parent, -1 for roots
+
+    JTCluster(const std::vector<int>& vars, const std::vector<int>& cards);
+};
+
+// Separator between a cluster and its parent. The stride tables map each
+// cluster variable to its stride in the separator table (0 if summed out),
+// so projections and updates run without any per-entry allocation.
+class JTSeparator {
+public:
+    int child;
+    int parent;
+    Factor table;                        // Last message passed across
+    std::vector<size_t> child_strides;
+    std::vector<size_t> parent_strides;
+};
+
+// Junction tree over the cliques of an MRF with exact sum-product
+// calibration (Hugin-style two-pass schedule)
+class JunctionTree {
+public:
+    std::vector<JTCluster> clusters;
+    std::vector<JTSeparator> separators;
+    std::vector<int> schedule;  // Clusters ordered parents-first
+
+    JunctionTree();
+
+    // Triangulate the MRF graph, link clusters by a maximum-weight spanning
+    // tree over separator sizes and load the clique potentials. Fails if the
+    // cluster tables would exceed max_table_entries in total.
+    bool build(const MRF& mrf, EliminationHeuristic heuristic = EliminationHeuristic::MIN_FILL,
+               double max_table_entries = 1e9);
+    // Collect towards the roots, then distribute back to the leaves
+    void calibrate();
+    // Normalized marginal of one variable (empty if unknown)
+    std::vector<double> marginal(int node_id) const;
+
+    void print() const;
+    void printMarginals(const MRF& mrf) const;
+
+    int getTreewidth() const;
+    double getTotalTableSize() const;
+
+private:
+    IdIndex node_index;              // Node id -> MRF node position
+    std::vector<int> home_cluster;   // MRF node position -> smallest cluster holding it
+    FactorBuffer scratch;            // Reused separator-sized buffer
+
+    void collect(int cluster);
+    void distribute(int cluster);
+};
+
+#endif // JUNCTION_TREE_H
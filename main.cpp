@@ -7,20 +7,33 @@
 #include "graph.h"
 #include "mrf.h"
 #include "qpu_circuit.h"
+#include "circuit_optimizer.h"
+#include "interaction_scheduler.h"
 #include "framework_exporters.h"
+#include "junction_tree.h"
+#include "model_parser.h"
+#include "model_binary.h"
+#include "compile_cache.h"
+#include "incremental.h"
+#include "batch.h"
+#include "simulator.h"
+#include "thread_pool.h"
+#include "arena.h"
 #include <iostream>
 #include <fstream>
-#include <sstream>
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <memory>
+#include <new>
+#include <cstring>
 
-// Simple parser for graphical model input
-GraphicalModel parseGraphicalModel(const std::string& filename) {
+// Parse a graphical model file (memory-mapped, see model_parser.h)
+GraphicalModel parseGraphicalModel(const std::string& filename, size_t num_threads) {
     GraphicalModel gm(GraphType::UNDIRECTED);
     
-    std::ifstream file(filename);
-    if (!file.is_open()) {
+    MappedFile file;
+    if (!file.open(filename)) {
         std::cerr << "Warning: Could not open file " << filename 
                   << ". Creating example model.\n";
         // Create example model
@@ -50,129 +63,98 @@ GraphicalModel parseGraphicalModel(const std::string& filename) {
         return gm;
     }
     
-    std::string line;
-    while (std::getline(file, line)) {
-        std::istringstream iss(line);
-        std::string command;
-        iss >> command;
-        
-        if (command == "NODE") {
-            int id;
-            std::string name;
-            int num_states = 2;
-            iss >> id >> name;
-            if (iss >> num_states) {}
-            gm.addNode(id, name, num_states);
-        } else if (command == "EDGE") {
-            int from, to;
-            bool directed = false;
-            iss >> from >> to;
-            std::string dir;
-            if (iss >> dir && dir == "directed") {
-                directed = true;
-            }
-            gm.addEdge(from, to, directed);
-        } else if (command == "TYPE") {
-            std::string type;
-            iss >> type;
-            if (type == "directed") {
-                gm.type = GraphType::DIRECTED;
-            } else {
-                gm.type = GraphType::UNDIRECTED;
-            }
-        } else if (command == "CPT") {
-            // Parse CPT: CPT <node_id> [parent_states...] <prob_state0> <prob_state1> ...
-            // Format examples:
-            //   CPT 0 0.8 0.2                    (root node, no parents)
-            //   CPT 2 0 0 0.99 0.01             (node 2 with parents in state 0,0)
-            //   CPT 2 0 1 0.9 0.1               (node 2 with parents in state 0,1)
-            //   CPT 2 1 0 0.8 0.2               (node 2 with parents in state 1,0)
-            //   CPT 2 1 1 0.0 1.0               (node 2 with parents in state 1,1)
-            
-            int node_id;
-            if (!(iss >> node_id)) {
-                std::cerr << "Warning: Invalid CPT command, missing node_id\n";
-                continue;
-            }
-            
-            Node* node = gm.getNode(node_id);
-            if (!node) {
-                std::cerr << "Warning: CPT specified for non-existent node " << node_id << "\n";
-                continue;
-            }
-            
-            // Get parents of this node
-            std::vector<int> parents = gm.getParents(node_id);
-            int num_parents = parents.size();
-            
-            // Read all remaining values
-            std::vector<double> values;
-            double val;
-            while (iss >> val) {
-                values.push_back(val);
-            }
-            
-            // Determine format: if we have exactly num_states values, it's a root node CPT
-            // Otherwise, we need to parse parent states + probabilities
-            if (num_parents == 0) {
-                // Root node: just probabilities
-                if (values.size() != (size_t)node->num_states) {
-                    std::cerr << "Warning: CPT for root node " << node_id 
-                              << " should have " << node->num_states << " values, got " 
-                              << values.size() << "\n";
-                    continue;
-                }
-                std::map<std::vector<int>, std::vector<double>> cpt_table;
-                cpt_table[std::vector<int>()] = values;  // Empty parent state vector
-                gm.setCPT(node_id, cpt_table);
-            } else {
-                // Node with parents: format is [parent_states...] [probabilities...]
-                // Each entry has num_parents parent states + num_states probabilities
-                int entry_size = num_parents + node->num_states;
-                if (values.size() % entry_size != 0) {
-                    std::cerr << "Warning: CPT for node " << node_id 
-                              << " has incorrect number of values. Expected multiple of " 
-                              << entry_size << ", got " << values.size() << "\n";
-                    continue;
-                }
-                
-                std::map<std::vector<int>, std::vector<double>> cpt_table;
-                for (size_t i = 0; i < values.size(); i += entry_size) {
-                    std::vector<int> parent_states;
-                    std::vector<double> probs;
-                    
-                    // Read parent states
-                    for (int j = 0; j < num_parents; j++) {
-                        parent_states.push_back((int)values[i + j]);
-                    }
-                    
-                    // Read probabilities
-                    for (int j = 0; j < node->num_states; j++) {
-                        probs.push_back(values[i + num_parents + j]);
-                    }
-                    
-                    cpt_table[parent_states] = probs;
-                }
-                gm.setCPT(node_id, cpt_table);
-            }
-        }
+    ModelParser parser;
+    parser.setThreads(num_threads);
+    parser.parse(file.data(), file.data() + file.size(), gm);
+    for (const ParseError& err : parser.getErrors()) {
+        std::cerr << "Warning: " << filename << ":" << err.toString() << "\n";
     }
-    
-    file.close();
     return gm;
 }
 
+// Rebuild mrf and circuit by patching the previous compilation of the same
+// source, if the cache still holds it and the edit is local
+static bool recompileFromCache(CompileCache& cache, const std::string& source,
+                               const GraphicalModel& gm, MRF& mrf, QPUCircuit& circuit) {
+    std::string prev_key;
+    if (source.empty() || !cache.previousKey(source, prev_key)) {
+        return false;
+    }
+    GraphicalModel prev_gm;
+    MRF prev_mrf;
+    QPUCircuit prev_circuit(0);
+    if (!cache.loadModel(prev_key, prev_gm, prev_mrf) || !cache.loadCircuit(prev_key, prev_circuit)) {
+        return false;
+    }
+    IncrementalStats stats;
+    if (!recompileIncremental(prev_gm, prev_mrf, prev_circuit, gm, mrf, circuit, stats)) {
+        std::cout << "Edit is not local, recompiling from scratch\n";
+        return false;
+    }
+    stats.print();
+    return true;
+}
+
+// Frameworks to export to: the selected one, or all of them with -a
+static std::vector<Framework> selectedFrameworks(bool export_all, Framework framework) {
+    if (export_all) {
+        return {Framework::QASM, Framework::QISKIT, Framework::CIRQ,
+                Framework::PENNYLANE, Framework::QSHARP, Framework::BRAKET,
+                Framework::QULACS, Framework::TENSORFLOW_QUANTUM};
+    }
+    return {framework};
+}
+
 void printUsage(const char* program_name) {
     std::cout << "Usage: " << program_name << " [options] [input_file] [output_file]\n";
     std::cout << "\nOptions:\n";
     std::cout << "  -f, --framework <name>  Output framework (default: qasm)\n";
     std::cout << "                          Supported: qasm, qiskit, cirq, pennylane, qsharp, braket, qulacs, tfq\n";
     std::cout << "  -a, --all               Export to all frameworks\n";
+    std::cout << "  -O, --optimize          Drop no-op rotations, merge rotations, cancel\n";
+    std::cout << "                          CNOT pairs and fuse CNOT-RZ-CNOT into RZZ\n";
+    std::cout << "  --schedule              Emit the commuting ZZ couplings in layers of\n";
+    std::cout << "                          disjoint pairs (same unitary)\n";
+    std::cout << "  --schedule-approx       Like --schedule, but sum each qubit's fields and\n";
+    std::cout << "                          move them ahead of all couplings (approximates\n";
+    std::cout << "                          the circuit for a much smaller depth)\n";
+    std::cout << "  -i, --infer             Print exact marginals (junction tree) instead of\n";
+    std::cout << "                          generating a circuit\n";
+    std::cout << "  --simulate              Run the circuit on the built-in statevector\n";
+    std::cout << "                          simulator and print measurement counts instead\n";
+    std::cout << "                          of exporting it\n";
+    std::cout << "  --shots <n>             Samples drawn by --simulate (default: 1024)\n";
+    std::cout << "  --benchmark             With --simulate, time the simulation on 1, 2, 4, ...\n";
+    std::cout << "                          up to -j threads instead of sampling\n";
+    std::cout << "  -t, --triangulate <h>   Report treewidth and clique-table size of the\n";
+    std::cout << "                          triangulated model (h: min-fill, min-degree)\n";
+    std::cout << "  -j, --jobs <n>          Threads for parsing the input and simulating, or\n";
+    std::cout << "                          models compiled at once with --batch (default:\n";
+    std::cout << "                          all cores)\n";
+    std::cout << "  --save-binary <file>    Save the model and compiled MRF in binary form\n";
+    std::cout << "  --load-binary <file>    Load a binary model instead of parsing input_file;\n";
+    std::cout << "                          a stored MRF is used as is (the only positional\n";
+    std::cout << "                          argument is then the output file)\n";
+    std::cout << "  --cache-dir <dir>       Reuse compiled MRFs, circuits and exported code\n";
+    std::cout << "                          from an on-disk cache keyed by the model's hash\n";
+    std::cout << "  --cache-size <MB>       Cache size limit, least recently used entries are\n";
+    std::cout << "                          evicted first (default: 1024)\n";
+    std::cout << "  --incremental           With --cache-dir, recompile an edited input by\n";
+    std::cout << "                          patching its previous compilation\n";
+    std::cout << "  --batch <manifest>      Compile every \"input_file [output_file]\" line of\n";
+    std::cout << "                          the manifest concurrently; outputs default to the\n";
+    std::cout << "                          input name with the framework's extension\n";
     std::cout << "  -h, --help              Show this help message\n";
     std::cout << "\nExamples:\n";
     std::cout << "  " << program_name << " example.txt output.qasm\n";
     std::cout << "  " << program_name << " -f qiskit example.txt circuit.py\n";
     std::cout << "  " << program_name << " -a example.txt\n";
+    std::cout << "  " << program_name << " -O -f qiskit example.txt circuit.py\n";
+    std::cout << "  " << program_name << " --infer bayesian_example.txt\n";
+    std::cout << "  " << program_name << " --save-binary model.mrfb example.txt\n";
+    std::cout << "  " << program_name << " --load-binary model.mrfb output.qasm\n";
+    std::cout << "  " << program_name << " --simulate --shots 4096 example.txt\n";
+    std::cout << "  " << program_name << " -j 8 --batch models.txt\n";
 }
 
 int main(int argc, char* argv[]) {
@@ -184,6 +166,22 @@ int main(int argc, char* argv[]) {
     std::string output_file = "";
     Framework framework = Framework::QASM;
     bool export_all = false;
+    bool optimize = false;
+    bool schedule = false;
+    bool hoist_fields = false;
+    bool triangulate = false;
+    bool infer = false;
+    bool simulate = false;
+    bool benchmark = false;
+    size_t shots = 1024;
+    EliminationHeuristic heuristic = EliminationHeuristic::MIN_FILL;
+    size_t num_threads = 0;
+    std::string save_binary = "";
+    std::string load_binary = "";
+    std::string cache_dir = "";
+    uint64_t cache_megabytes = 1024;
+    bool incremental = false;
+    std::string batch_manifest = "";
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -200,6 +198,85 @@ int main(int argc, char* argv[]) {
             }
         } else if (arg == "-a" || arg == "--all") {
             export_all = true;
+        } else if (arg == "-O" || arg == "--optimize") {
+            optimize = true;
+        } else if (arg == "--schedule") {
+            schedule = true;
+        } else if (arg == "--schedule-approx") {
+            schedule = true;
+            hoist_fields = true;
+        } else if (arg == "-i" || arg == "--infer") {
+            infer = true;
+        } else if (arg == "--simulate") {
+            simulate = true;
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--shots") {
+            int count = 0;
+            if (i + 1 < argc && scanInt(argv[i + 1], argv[i + 1] + std::strlen(argv[i + 1]), count) && count > 0) {
+                shots = (size_t)count;
+                i++;
+            } else {
+                std::cerr << "Error: --shots requires a positive number of shots\n";
+                return 1;
+            }
+        } else if (arg == "-t" || arg == "--triangulate") {
+            if (i + 1 < argc) {
+                std::string name = argv[++i];
+                if (name == "min-fill") {
+                    heuristic = EliminationHeuristic::MIN_FILL;
+                } else if (name == "min-degree") {
+                    heuristic = EliminationHeuristic::MIN_DEGREE;
+                } else {
+                    std::cerr << "Error: unknown elimination heuristic " << name << "\n";
+                    return 1;
+                }
+                triangulate = true;
+            } else {
+                std::cerr << "Error: -t requires a heuristic name\n";
+                return 1;
+            }
+        } else if (arg == "-j" || arg == "--jobs") {
+            int jobs = 0;
+            if (i + 1 < argc && scanInt(argv[i + 1], argv[i + 1] + std::strlen(argv[i + 1]), jobs) && jobs > 0) {
+                num_threads = (size_t)jobs;
+                i++;
+            } else {
+                std::cerr << "Error: -j requires a positive thread count\n";
+                return 1;
+            }
+        } else if (arg == "--save-binary" || arg == "--load-binary") {
+            if (i + 1 < argc) {
+                (arg == "--save-binary" ? save_binary : load_binary) = argv[++i];
+            } else {
+                std::cerr << "Error: " << arg << " requires a file name\n";
+                return 1;
+            }
+        } else if (arg == "--batch") {
+            if (i + 1 < argc) {
+                batch_manifest = argv[++i];
+            } else {
+                std::cerr << "Error: --batch requires a manifest file\n";
+                return 1;
+            }
+        } else if (arg == "--cache-dir") {
+            if (i + 1 < argc) {
+                cache_dir = argv[++i];
+            } else {
+                std::cerr << "Error: --cache-dir requires a directory\n";
+                return 1;
+            }
+        } else if (arg == "--incremental") {
+            incremental = true;
+        } else if (arg == "--cache-size") {
+            int megabytes = 0;
+            if (i + 1 < argc && scanInt(argv[i + 1], argv[i + 1] + std::strlen(argv[i + 1]), megabytes) && megabytes >= 0) {
+                cache_megabytes = (uint64_t)megabytes;
+                i++;
+            } else {
+                std::cerr << "Error: --cache-size requires a size in megabytes\n";
+                return 1;
+            }
         } else if (arg[0] != '-') {
             if (input_file.empty()) {
                 input_file = arg;
@@ -209,68 +286,268 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (!batch_manifest.empty()) {
+        // Many small models: per-model reports instead of the step-by-step
+        // printout, each model compiled independently in its own arena
+        if (infer || simulate || schedule || triangulate || incremental || !save_binary.empty() ||
+            !load_binary.empty() || !cache_dir.empty() || !input_file.empty()) {
+            std::cerr << "Warning: --batch only uses -f, -a, -O and -j; other options and file "
+                      << "arguments are ignored\n";
+        }
+        std::vector<BatchJob> jobs;
+        if (!readBatchManifest(batch_manifest, jobs)) {
+            return 1;
+        }
+        std::cout << "=== Batch: " << jobs.size() << " models from " << batch_manifest << " ===\n";
+        std::vector<BatchResult> results = runBatch(jobs, selectedFrameworks(export_all, framework),
+                                                    optimize, num_threads);
+        return printBatchReport(jobs, results) > 0 ? 1 : 0;
+    }
+    
+    // The model, MRF and circuit of this compilation are built in one arena
+    // and released together when main returns
+    Arena arena;
+    ArenaScope arena_scope(arena);
+    
     // Step 1: Parse graphical model
     std::cout << "=== Step 1: Parsing Graphical Model ===\n";
-    GraphicalModel gm = parseGraphicalModel(input_file);
+    GraphicalModel gm;
+    MRF mrf;
+    bool have_mrf = false;
+    if (!load_binary.empty()) {
+        // There is no input file, so a lone positional argument is the output
+        if (output_file.empty()) {
+            output_file = input_file;
+        }
+        BinaryModelFile binary;
+        if (!binary.open(load_binary) || !binary.loadGraphicalModel(gm)) {
+            return 1;
+        }
+        if (binary.hasMRF()) {
+            if (!binary.loadMRF(mrf)) {
+                return 1;
+            }
+            have_mrf = true;
+        }
+        std::cout << "Loaded binary model " << load_binary
+                  << (have_mrf ? " (with compiled MRF)" : "") << "\n";
+    } else {
+        gm = parseGraphicalModel(input_file, num_threads);
+        // Structure is final after parsing; switch to the compact adjacency
+        gm.freezeAdjacency();
+    }
     gm.print();
     std::cout << "\n";
     
+    // Later stages are looked up by the hash of the parsed model
+    std::unique_ptr<CompileCache> cache;
+    std::string cache_key;
+    if (!cache_dir.empty()) {
+        cache.reset(new CompileCache(cache_dir, cache_megabytes << 20));
+        cache_key = cache->modelKey(gm);
+    } else if (incremental) {
+        std::cerr << "Warning: --incremental needs --cache-dir, compiling from scratch\n";
+    }
+    std::string source = load_binary.empty() ? input_file : load_binary;
+    
+    if (triangulate) {
+        // Triangulate a copy so the compiled circuit is unaffected
+        std::cout << "=== Triangulating Graphical Model ===\n";
+        GraphicalModel chordal = gm;
+        TriangulationResult result = triangulateGraph(chordal, heuristic);
+        result.print();
+        std::cout << "\n";
+    }
+    
     // Step 2: Convert to MRF
     std::cout << "=== Step 2: Converting to MRF ===\n";
-    MRF mrf = convertToMRF(gm);
+    QPUCircuit circuit(0);
+    bool patched = false;  // mrf and circuit came from an incremental recompilation
+    if (!have_mrf) {
+        if (cache && cache->loadMRF(cache_key, mrf)) {
+            std::cout << "Loaded compiled MRF from cache\n";
+        } else {
+            if (cache && incremental) {
+                patched = recompileFromCache(*cache, source, gm, mrf, circuit);
+            }
+            if (!patched) {
+                mrf = convertToMRF(gm);
+            }
+            if (cache) {
+                cache->storeMRF(cache_key, gm, mrf);
+            }
+        }
+    }
+    if (cache && !source.empty()) {
+        cache->recordSource(source, cache_key);
+    }
     mrf.print();
     std::cout << "\n";
     
+    if (!save_binary.empty()) {
+        if (!saveBinaryModel(save_binary, gm, &mrf)) {
+            return 1;
+        }
+        std::cout << "Saved binary model -> " << save_binary << "\n\n";
+    }
+    
+    if (infer) {
+        // Exact classical inference instead of circuit generation
+        std::cout << "=== Step 3: Exact Inference (Junction Tree) ===\n";
+        JunctionTree tree;
+        if (!tree.build(mrf, heuristic)) {
+            std::cerr << "Error: model is too large for exact inference\n";
+            return 1;
+        }
+        tree.print();
+        tree.calibrate();
+        tree.printMarginals(mrf);
+        std::cout << "\n";
+        if (cache) {
+            cache->evict();
+            cache->printStats();
+        }
+        return 0;
+    }
+    
     // Step 3: Convert MRF to QPU Circuit
     std::cout << "=== Step 3: Converting MRF to QPU Circuit ===\n";
-    QPUCircuit circuit = convertMRFToQPU(mrf);
+    if (patched) {
+        cache->storeCircuit(cache_key, circuit);
+    } else if (!cache || !cache->loadCircuit(cache_key, circuit)) {
+        circuit = convertMRFToQPU(mrf);
+        if (cache) {
+            cache->storeCircuit(cache_key, circuit);
+        }
+    }
+    // The cache keeps the circuit as compiled; scheduling and optimizing are
+    // cheap enough to repeat on every run
+    if (schedule) {
+        scheduleInteractions(circuit, hoist_fields).print();
+    }
+    if (optimize) {
+        optimizeCircuit(circuit).print();
+    }
     circuit.print();
     std::cout << "\n";
     
-    // Step 4: Export to framework(s)
-    std::vector<Framework> frameworks;
-    if (export_all) {
-        frameworks = {Framework::QASM, Framework::QISKIT, Framework::CIRQ, 
-                     Framework::PENNYLANE, Framework::QSHARP, Framework::BRAKET,
-                     Framework::QULACS, Framework::TENSORFLOW_QUANTUM};
-    } else {
-        frameworks = {framework};
+    if (simulate) {
+        // Sample the circuit natively instead of exporting it
+        std::cout << "=== Step 4: Simulating Circuit (Statevector) ===\n";
+        if (benchmark) {
+            if (!benchmarkSimulation(circuit, num_threads)) {
+                return 1;
+            }
+        } else {
+            SimulationResult result;
+            if (!simulateCircuit(circuit, shots, result, num_threads)) {
+                return 1;
+            }
+            result.print();
+        }
+        std::cout << "\n";
+        if (cache) {
+            cache->evict();
+            cache->printStats();
+        }
+        return 0;
     }
     
+    // Step 4: Export to framework(s)
+    std::vector<Framework> frameworks = selectedFrameworks(export_all, framework);
+    
     std::cout << "=== Step 4: Exporting to Framework(s) ===\n";
+    size_t num_exports = frameworks.size();
+    std::vector<std::unique_ptr<FrameworkExporter>> exporters;
+    std::vector<std::string> filenames;
+    std::vector<std::string> tags;
     for (Framework fw : frameworks) {
-        FrameworkExporter* exporter = createExporter(fw);
-        std::string code = exporter->exportCircuit(circuit, "mrf_circuit");
-        
+        exporters.emplace_back(createExporter(fw));
+        const FrameworkExporter& exporter = *exporters.back();
         std::string filename = output_file;
         if (export_all || filename.empty()) {
-            filename = "output." + exporter->getFileExtension();
+            filename = "output." + exporter.getFileExtension();
             if (export_all) {
-                filename = "output_" + frameworkToString(fw) + "." + exporter->getFileExtension();
+                filename = "output_" + frameworkToString(fw) + "." + exporter.getFileExtension();
             }
         }
-        
-        std::ofstream outfile(filename);
-        if (outfile.is_open()) {
-            outfile << code;
+        filenames.push_back(filename);
+        // Exported code also depends on the framework and the circuit name
+        std::string passes = std::string(hoist_fields ? "sched-approx." : schedule ? "sched." : "") +
+                             (optimize ? "opt." : "");
+        tags.push_back("mrf_circuit." + passes + frameworkToString(fw) + "." + exporter.getFileExtension());
+    }
+    
+    // Code is only held in memory when it is cached or printed; otherwise
+    // each exporter streams straight into its file
+    bool print_code = !export_all && num_exports == 1;
+    bool keep_code = cache || print_code;
+    std::vector<std::string> codes(num_exports);
+    std::vector<char> have_code(num_exports, 0);
+    std::vector<char> written(num_exports, 0);
+    std::vector<char> out_of_memory(num_exports, 0);
+    if (cache) {
+        for (size_t k = 0; k < num_exports; k++) {
+            have_code[k] = cache->loadText(cache_key, tags[k], codes[k]);
+        }
+    }
+    
+    // The circuit is shared read-only, so the exporters run side by side
+    ThreadPool pool(std::min(num_exports, ThreadPool::hardwareThreads()));
+    pool.parallelFor(num_exports, [&](size_t k) {
+        if (have_code[k]) {
+            return;
+        }
+        // One exporter running out of memory fails only its own file
+        try {
+            if (keep_code) {
+                codes[k] = exporters[k]->exportCircuit(circuit, "mrf_circuit");
+            } else {
+                written[k] = exporters[k]->exportToFile(circuit, "mrf_circuit", filenames[k]);
+            }
+        } catch (const std::bad_alloc&) {
+            std::string().swap(codes[k]);
+            out_of_memory[k] = 1;
+        }
+    });
+    
+    for (size_t k = 0; k < num_exports; k++) {
+        const FrameworkExporter& exporter = *exporters[k];
+        if (out_of_memory[k]) {
+            std::cerr << "Error: out of memory exporting to " << exporter.getFrameworkName() << ", "
+                      << filenames[k] << " not written\n";
+            continue;
+        }
+        if (keep_code) {
+            if (cache && !have_code[k]) {
+                cache->storeText(cache_key, tags[k], codes[k]);
+            }
+            std::ofstream outfile(filenames[k]);
+            outfile << codes[k];
             outfile.close();
-            std::cout << "Exported to " << exporter->getFrameworkName() 
-                      << " -> " << filename << "\n";
+            written[k] = !outfile.fail();
+        }
+        if (written[k]) {
+            std::cout << "Exported to " << exporter.getFrameworkName() 
+                      << " -> " << filenames[k] << "\n";
         } else {
-            std::cerr << "Warning: Could not write to " << filename << "\n";
+            std::cerr << "Warning: Could not write to " << filenames[k] << "\n";
         }
         
         // Also print to console for single framework
-        if (!export_all && frameworks.size() == 1) {
-            std::cout << "\n" << exporter->getFrameworkName() << " Code:\n";
+        if (print_code) {
+            std::cout << "\n" << exporter.getFrameworkName() << " Code:\n";
             std::cout << "----------------------------------------\n";
-            std::cout << code;
+            std::cout << codes[k];
             std::cout << "----------------------------------------\n";
         }
-        
-        delete exporter;
     }
     std::cout << "\n";
     
+    if (cache) {
+        cache->evict();
+        cache->printStats();
+    }
+    
     return 0;
 }
@@ -0,0 +1,533 @@
+#include "model_binary.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+static const char BINARY_MAGIC[8] = {'M', 'R', 'F', 'B', 'I', 'N', 0, 0};
+static const uint32_t BINARY_BYTE_ORDER = 0x01020304;
+static const uint64_t SECTION_ALIGNMENT = 64;
+static const uint64_t DOUBLES_PER_LINE = SECTION_ALIGNMENT / sizeof(double);
+
+// Record size of each known section, indexed by BinarySection
+static const uint32_t SECTION_RECORD_SIZES[(size_t)BinarySection::COUNT] = {
+    0,
+    sizeof(BinaryNode),    // NODES
+    sizeof(BinaryEdge),    // EDGES
+    sizeof(int32_t),       // CSR_VERTICES
+    sizeof(uint64_t),      // CSR_OFFSETS
+    sizeof(int32_t),       // CSR_NEIGHBORS
+    sizeof(BinaryNode),    // MRF_NODES
+    sizeof(BinaryClique),  // CLIQUES
+    sizeof(int32_t),       // MRF_CSR_VERTICES
+    sizeof(uint64_t),      // MRF_CSR_OFFSETS
+    sizeof(int32_t),       // MRF_CSR_NEIGHBORS
+    sizeof(char),          // NAMES
+    sizeof(int32_t),       // INTS
+    sizeof(uint8_t),       // FLAGS
+    sizeof(double)         // DOUBLES
+};
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+// Writer
+
+// Part of the DOUBLES pool, written straight from the model's buffers. A
+// null data pointer stands for zero padding.
+class DoubleSpan {
+public:
+    const double* data;
+    uint64_t count;
+};
+
+// Section contents before layout
+class SectionSource {
+public:
+    BinarySection id;
+    const void* data;  // Unused for DOUBLES, which is written from spans
+    uint64_t count;
+};
+
+class BinaryModelWriter {
+public:
+    std::vector<BinaryNode> nodes;
+    std::vector<BinaryEdge> edges;
+    std::vector<BinaryNode> mrf_nodes;
+    std::vector<BinaryClique> cliques;
+    std::vector<char> names;
+    std::vector<int32_t> ints;
+    std::vector<uint8_t> flags;
+    std::vector<DoubleSpan> spans;
+    uint64_t num_doubles;
+
+    BinaryModelWriter() : num_doubles(0) {}
+
+    // Offset of a buffer appended to DOUBLES, optionally on a fresh cache line
+    uint64_t addDoubles(const double* data, uint64_t count, bool align = true) {
+        if (align && num_doubles % DOUBLES_PER_LINE != 0) {
+            DoubleSpan pad = {nullptr, DOUBLES_PER_LINE - num_doubles % DOUBLES_PER_LINE};
+            spans.push_back(pad);
+            num_doubles += pad.count;
+        }
+        uint64_t offset = num_doubles;
+        DoubleSpan span = {data, count};
+        spans.push_back(span);
+        num_doubles += count;
+        return offset;
+    }
+
+    BinaryNode addNode(const Node& node) {
+        BinaryNode record = BinaryNode();
+        record.id = node.id;
+        record.num_states = node.num_states;
+        record.name_offset = names.size();
+        record.name_length = node.name.size();
+        names.insert(names.end(), node.name.begin(), node.name.end());
+        record.potential_offset = addDoubles(node.potential.data(), node.potential.size());
+        record.potential_count = node.potential.size();
+        record.has_cpt = node.has_cpt ? 1 : 0;
+
+        const DenseCPT& cpt = node.cpt;
+        if (!cpt.empty()) {
+            record.cpt_num_states = cpt.num_states;
+            record.cpt_num_parents = cpt.parent_cards.size();
+            record.cpt_cards_offset = ints.size();
+            ints.insert(ints.end(), cpt.parent_cards.begin(), cpt.parent_cards.end());
+            record.cpt_num_rows = cpt.numRows();
+            record.cpt_probs_offset = addDoubles(cpt.probs.data(), cpt.probs.size());
+            record.cpt_rows_offset = flags.size();
+            for (size_t r = 0; r < cpt.numRows(); r++) {
+                flags.push_back(cpt.row_set[r] ? 1 : 0);
+            }
+        }
+        return record;
+    }
+
+    void addEdge(const Edge& edge) {
+        BinaryEdge record = BinaryEdge();
+        record.from = edge.from;
+        record.to = edge.to;
+        record.directed = edge.directed ? 1 : 0;
+        record.num_rows = (uint32_t)edge.potential.size();
+        record.row_lengths_offset = ints.size();
+        record.potential_offset = num_doubles;
+        for (size_t r = 0; r < edge.potential.size(); r++) {
+            ints.push_back((int32_t)edge.potential[r].size());
+            uint64_t offset = addDoubles(edge.potential[r].data(), edge.potential[r].size(), r == 0);
+            if (r == 0) {
+                record.potential_offset = offset;
+            }
+        }
+        edges.push_back(record);
+    }
+
+    void addClique(const Clique& clique) {
+        BinaryClique record = BinaryClique();
+        record.vars_offset = ints.size();
+        record.num_vars = clique.vars.size();
+        ints.insert(ints.end(), clique.vars.begin(), clique.vars.end());
+        ints.insert(ints.end(), clique.cards.begin(), clique.cards.end());
+        record.values_offset = addDoubles(clique.values.data(), clique.values.size());
+        record.num_values = clique.values.size();
+        cliques.push_back(record);
+    }
+};
+
+static void writePadding(std::ofstream& out, uint64_t& position, uint64_t target) {
+    static const char zeros[SECTION_ALIGNMENT] = {0};
+    while (position < target) {
+        uint64_t chunk = std::min<uint64_t>(target - position, SECTION_ALIGNMENT);
+        out.write(zeros, (std::streamsize)chunk);
+        position += chunk;
+    }
+}
+
+bool saveBinaryModel(const std::string& path, const GraphicalModel& gm, const MRF* mrf) {
+    BinaryModelWriter writer;
+    writer.nodes.reserve(gm.nodes.size());
+    for (const auto& node : gm.nodes) {
+        writer.nodes.push_back(writer.addNode(node));
+    }
+    for (const auto& edge : gm.edges) {
+        writer.addEdge(edge);
+    }
+    CSRAdjacency gm_csr = gm.buildAdjacency();
+    std::vector<uint64_t> gm_offsets(gm_csr.offsets.begin(), gm_csr.offsets.end());
+
+    CSRAdjacency mrf_csr;
+    std::vector<uint64_t> mrf_offsets;
+    if (mrf) {
+        for (const auto& node : mrf->nodes) {
+            writer.mrf_nodes.push_back(writer.addNode(node));
+        }
+        for (const auto& clique : mrf->cliques) {
+            writer.addClique(clique);
+        }
+        mrf_csr = mrf->buildAdjacency();
+        mrf_offsets.assign(mrf_csr.offsets.begin(), mrf_csr.offsets.end());
+    }
+
+    std::vector<SectionSource> sources = {
+        {BinarySection::NODES, writer.nodes.data(), writer.nodes.size()},
+        {BinarySection::EDGES, writer.edges.data(), writer.edges.size()},
+        {BinarySection::CSR_VERTICES, gm_csr.vertex_ids.data(), gm_csr.vertex_ids.size()},
+        {BinarySection::CSR_OFFSETS, gm_offsets.data(), gm_offsets.size()},
+        {BinarySection::CSR_NEIGHBORS, gm_csr.neighbors.data(), gm_csr.neighbors.size()},
+    };
+    if (mrf) {
+        std::vector<SectionSource> mrf_sources = {
+            {BinarySection::MRF_NODES, writer.mrf_nodes.data(), writer.mrf_nodes.size()},
+            {BinarySection::CLIQUES, writer.cliques.data(), writer.cliques.size()},
+            {BinarySection::MRF_CSR_VERTICES, mrf_csr.vertex_ids.data(), mrf_csr.vertex_ids.size()},
+            {BinarySection::MRF_CSR_OFFSETS, mrf_offsets.data(), mrf_offsets.size()},
+            {BinarySection::MRF_CSR_NEIGHBORS, mrf_csr.neighbors.data(), mrf_csr.neighbors.size()},
+        };
+        sources.insert(sources.end(), mrf_sources.begin(), mrf_sources.end());
+    }
+    std::vector<SectionSource> pools = {
+        {BinarySection::NAMES, writer.names.data(), writer.names.size()},
+        {BinarySection::INTS, writer.ints.data(), writer.ints.size()},
+        {BinarySection::FLAGS, writer.flags.data(), writer.flags.size()},
+        {BinarySection::DOUBLES, nullptr, writer.num_doubles},
+    };
+    sources.insert(sources.end(), pools.begin(), pools.end());
+
+    // Layout: header, section table, then each section on a 64-byte boundary
+    std::vector<BinarySectionEntry> table(sources.size());
+    uint64_t position = sizeof(BinaryHeader) + sources.size() * sizeof(BinarySectionEntry);
+    for (size_t i = 0; i < sources.size(); i++) {
+        table[i].id = (uint32_t)sources[i].id;
+        table[i].record_size = SECTION_RECORD_SIZES[(size_t)sources[i].id];
+        table[i].offset = alignUp(position, SECTION_ALIGNMENT);
+        table[i].count = sources[i].count;
+        position = table[i].offset + table[i].count * table[i].record_size;
+    }
+
+    BinaryHeader header = BinaryHeader();
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.version = BINARY_MODEL_VERSION;
+    header.byte_order = BINARY_BYTE_ORDER;
+    header.graph_type = (uint32_t)gm.type;
+    header.has_mrf = mrf ? 1 : 0;
+    header.num_sections = (uint32_t)table.size();
+    header.file_size = position;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        std::cerr << "Error: could not write binary model " << path << "\n";
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()),
+              (std::streamsize)(table.size() * sizeof(BinarySectionEntry)));
+    position = sizeof(BinaryHeader) + table.size() * sizeof(BinarySectionEntry);
+    for (size_t i = 0; i < sources.size(); i++) {
+        writePadding(out, position, table[i].offset);
+        if (sources[i].id == BinarySection::DOUBLES) {
+            for (const DoubleSpan& span : writer.spans) {
+                if (span.data) {
+                    out.write(reinterpret_cast<const char*>(span.data),
+                              (std::streamsize)(span.count * sizeof(double)));
+                    position += span.count * sizeof(double);
+                } else {
+                    writePadding(out, position, position + span.count * sizeof(double));
+                }
+            }
+        } else {
+            uint64_t bytes = table[i].count * table[i].record_size;
+            out.write(static_cast<const char*>(sources[i].data), (std::streamsize)bytes);
+            position += bytes;
+        }
+    }
+    out.close();
+    if (!out) {
+        std::cerr << "Error: could not write binary model " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// BinaryModelFile implementation
+BinaryModelFile::BinaryModelFile() : header(nullptr) {
+    std::fill(section_data, section_data + (size_t)BinarySection::COUNT, nullptr);
+    std::fill(section_count, section_count + (size_t)BinarySection::COUNT, 0);
+}
+
+bool BinaryModelFile::fail(const std::string& message) const {
+    std::cerr << "Error: " << path << ": " << message << "\n";
+    return false;
+}
+
+bool BinaryModelFile::open(const std::string& path) {
+    this->path = path;
+    header = nullptr;
+    if (!file.open(path)) {
+        return fail("could not open binary model");
+    }
+    const char* base = file.data();
+    uint64_t size = file.size();
+    if (size < sizeof(BinaryHeader) || std::memcmp(base, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0) {
+        return fail("not a binary model file");
+    }
+    const BinaryHeader* candidate = reinterpret_cast<const BinaryHeader*>(base);
+    if (candidate->byte_order != BINARY_BYTE_ORDER) {
+        return fail("binary model was written with a different byte order");
+    }
+    if (candidate->version != BINARY_MODEL_VERSION) {
+        return fail("unsupported binary model version " + std::to_string(candidate->version) +
+                    " (expected " + std::to_string(BINARY_MODEL_VERSION) + ")");
+    }
+    if (candidate->file_size != size ||
+        candidate->num_sections > (size - sizeof(BinaryHeader)) / sizeof(BinarySectionEntry)) {
+        return fail("binary model is truncated");
+    }
+
+    const BinarySectionEntry* table =
+        reinterpret_cast<const BinarySectionEntry*>(base + sizeof(BinaryHeader));
+    for (uint32_t i = 0; i < candidate->num_sections; i++) {
+        const BinarySectionEntry& entry = table[i];
+        if (entry.id == 0 || entry.id >= (uint32_t)BinarySection::COUNT) {
+            continue;  // Section from a newer writer
+        }
+        if (entry.record_size != SECTION_RECORD_SIZES[entry.id] ||
+            entry.offset % sizeof(uint64_t) != 0 || entry.offset > size ||
+            entry.count > (size - entry.offset) / entry.record_size) {
+            return fail("corrupt section table");
+        }
+        section_data[entry.id] = base + entry.offset;
+        section_count[entry.id] = entry.count;
+    }
+    header = candidate;
+    return true;
+}
+
+GraphType BinaryModelFile::graphType() const {
+    return header && header->graph_type == (uint32_t)GraphType::DIRECTED ? GraphType::DIRECTED
+                                                                        : GraphType::UNDIRECTED;
+}
+
+const double* BinaryModelFile::doubles(uint64_t offset) const {
+    return reinterpret_cast<const double*>(section_data[(size_t)BinarySection::DOUBLES]) + offset;
+}
+
+const int32_t* BinaryModelFile::ints(uint64_t offset) const {
+    return reinterpret_cast<const int32_t*>(section_data[(size_t)BinarySection::INTS]) + offset;
+}
+
+std::string BinaryModelFile::nodeName(const BinaryNode& node) const {
+    if (!inPool(BinarySection::NAMES, node.name_offset, node.name_length)) {
+        return std::string();
+    }
+    return std::string(section_data[(size_t)BinarySection::NAMES] + node.name_offset,
+                       node.name_length);
+}
+
+bool BinaryModelFile::inPool(BinarySection pool, uint64_t offset, uint64_t count) const {
+    uint64_t size = section_count[(size_t)pool];
+    return offset <= size && count <= size - offset;
+}
+
+bool BinaryModelFile::loadNode(const BinaryNode& record, Node& node) const {
+    if (record.num_states < 0 ||
+        !inPool(BinarySection::NAMES, record.name_offset, record.name_length) ||
+        !inPool(BinarySection::DOUBLES, record.potential_offset, record.potential_count)) {
+        return false;
+    }
+    node = Node(record.id, nodeName(record), record.num_states);
+    const double* potential = doubles(record.potential_offset);
+    node.potential.assign(potential, potential + record.potential_count);
+    node.has_cpt = record.has_cpt != 0;
+    if (record.cpt_num_rows == 0) {
+        return true;
+    }
+
+    // Check the table shape before allocating anything for it
+    if (record.cpt_num_states <= 0 ||
+        !inPool(BinarySection::INTS, record.cpt_cards_offset, record.cpt_num_parents) ||
+        !inPool(BinarySection::FLAGS, record.cpt_rows_offset, record.cpt_num_rows) ||
+        record.cpt_num_rows > section_count[(size_t)BinarySection::DOUBLES] / record.cpt_num_states ||
+        !inPool(BinarySection::DOUBLES, record.cpt_probs_offset,
+                record.cpt_num_rows * record.cpt_num_states)) {
+        return false;
+    }
+    const int32_t* cards = ints(record.cpt_cards_offset);
+    uint64_t rows = 1;
+    for (uint64_t p = 0; p < record.cpt_num_parents; p++) {
+        if (cards[p] <= 0 || rows > record.cpt_num_rows / cards[p]) {
+            return false;
+        }
+        rows *= cards[p];
+    }
+    if (rows != record.cpt_num_rows) {
+        return false;
+    }
+    node.cpt.reset(record.cpt_num_states, std::vector<int>(cards, cards + record.cpt_num_parents));
+    const double* probs = doubles(record.cpt_probs_offset);
+    std::copy(probs, probs + node.cpt.probs.size(), node.cpt.probs.begin());
+    const uint8_t* row_set =
+        reinterpret_cast<const uint8_t*>(section_data[(size_t)BinarySection::FLAGS]) + record.cpt_rows_offset;
+    for (uint64_t r = 0; r < rows; r++) {
+        node.cpt.row_set[r] = row_set[r] != 0;
+    }
+    return true;
+}
+
+bool BinaryModelFile::loadAdjacency(BinarySection vertices, BinarySection offsets,
+                                    BinarySection neighbors, const std::vector<Node>& nodes,
+                                    CSRAdjacency& csr) const {
+    size_t num_vertices;
+    size_t num_offsets;
+    size_t num_neighbors;
+    const int32_t* ids = records<int32_t>(vertices, num_vertices);
+    const uint64_t* offset_data = records<uint64_t>(offsets, num_offsets);
+    const int32_t* neighbor_data = records<int32_t>(neighbors, num_neighbors);
+    if (num_offsets != num_vertices + 1 || offset_data[0] != 0 ||
+        offset_data[num_vertices] != num_neighbors) {
+        return false;
+    }
+    // Vertex v is node v (qubits are numbered by it), and vertex ids are
+    // distinct
+    if (num_vertices < nodes.size()) {
+        return false;
+    }
+    for (size_t v = 0; v < nodes.size(); v++) {
+        if (ids[v] != nodes[v].id) {
+            return false;
+        }
+    }
+    std::vector<int32_t> sorted_ids(ids, ids + num_vertices);
+    std::sort(sorted_ids.begin(), sorted_ids.end());
+    if (std::adjacent_find(sorted_ids.begin(), sorted_ids.end()) != sorted_ids.end()) {
+        return false;
+    }
+    // hasEdge binary-searches each list, so lists must be strictly increasing
+    for (size_t v = 0; v < num_vertices; v++) {
+        if (offset_data[v] > offset_data[v + 1]) {
+            return false;
+        }
+        for (uint64_t i = offset_data[v]; i < offset_data[v + 1]; i++) {
+            if (neighbor_data[i] < 0 || (size_t)neighbor_data[i] >= num_vertices ||
+                (i > offset_data[v] && neighbor_data[i] <= neighbor_data[i - 1])) {
+                return false;
+            }
+        }
+    }
+    csr.assign(ids, num_vertices, offset_data, neighbor_data);
+    return true;
+}
+
+bool BinaryModelFile::loadGraphicalModel(GraphicalModel& gm) const {
+    if (!isOpen()) {
+        return false;
+    }
+    gm = GraphicalModel(graphType());
+
+    size_t num_nodes;
+    const BinaryNode* nodes = records<BinaryNode>(BinarySection::NODES, num_nodes);
+    gm.nodes.reserve(num_nodes);
+    for (size_t i = 0; i < num_nodes; i++) {
+        gm.nodes.emplace_back(0, "");
+        if (!loadNode(nodes[i], gm.nodes.back())) {
+            return fail("corrupt node record " + std::to_string(i));
+        }
+    }
+
+    size_t num_edges;
+    const BinaryEdge* edges = records<BinaryEdge>(BinarySection::EDGES, num_edges);
+    gm.edges.reserve(num_edges);
+    for (size_t i = 0; i < num_edges; i++) {
+        const BinaryEdge& record = edges[i];
+        gm.edges.emplace_back(record.from, record.to, record.directed != 0);
+        if (!inPool(BinarySection::INTS, record.row_lengths_offset, record.num_rows)) {
+            return fail("corrupt edge record " + std::to_string(i));
+        }
+        const int32_t* lengths = ints(record.row_lengths_offset);
+        uint64_t offset = record.potential_offset;
+        Edge& edge = gm.edges.back();
+        edge.potential.resize(record.num_rows);
+        for (uint32_t r = 0; r < record.num_rows; r++) {
+            if (lengths[r] < 0 || !inPool(BinarySection::DOUBLES, offset, lengths[r])) {
+                return fail("corrupt edge record " + std::to_string(i));
+            }
+            edge.potential[r].assign(doubles(offset), doubles(offset) + lengths[r]);
+            offset += lengths[r];
+        }
+    }
+
+    CSRAdjacency csr;
+    if (section_count[(size_t)BinarySection::CSR_OFFSETS] == 0) {
+        // No stored adjacency: derive it from the edges
+        gm.rebuildIndices();
+        gm.freezeAdjacency();
+    } else if (loadAdjacency(BinarySection::CSR_VERTICES, BinarySection::CSR_OFFSETS,
+                             BinarySection::CSR_NEIGHBORS, gm.nodes, csr)) {
+        gm.restoreFrozen(std::move(csr));
+    } else {
+        return fail("corrupt graph adjacency");
+    }
+    return true;
+}
+
+bool BinaryModelFile::loadMRF(MRF& mrf) const {
+    if (!hasMRF()) {
+        return false;
+    }
+    mrf = MRF();
+
+    size_t num_nodes;
+    const BinaryNode* nodes = records<BinaryNode>(BinarySection::MRF_NODES, num_nodes);
+    mrf.nodes.reserve(num_nodes);
+    for (size_t i = 0; i < num_nodes; i++) {
+        mrf.nodes.emplace_back(0, "");
+        if (!loadNode(nodes[i], mrf.nodes.back())) {
+            return fail("corrupt MRF node record " + std::to_string(i));
+        }
+    }
+
+    // The adjacency comes first: clique variables are checked against it
+    CSRAdjacency csr;
+    if (!loadAdjacency(BinarySection::MRF_CSR_VERTICES, BinarySection::MRF_CSR_OFFSETS,
+                       BinarySection::MRF_CSR_NEIGHBORS, mrf.nodes, csr)) {
+        return fail("corrupt MRF adjacency");
+    }
+
+    size_t num_cliques;
+    const BinaryClique* cliques = records<BinaryClique>(BinarySection::CLIQUES, num_cliques);
+    mrf.cliques.reserve(num_cliques);
+    for (size_t i = 0; i < num_cliques; i++) {
+        const BinaryClique& record = cliques[i];
+        if (record.num_vars > section_count[(size_t)BinarySection::INTS] / 2 ||
+            !inPool(BinarySection::INTS, record.vars_offset, 2 * record.num_vars) ||
+            !inPool(BinarySection::DOUBLES, record.values_offset, record.num_values)) {
+            return fail("corrupt clique record " + std::to_string(i));
+        }
+        const int32_t* vars = ints(record.vars_offset);
+        const int32_t* cards = vars + record.num_vars;
+        uint64_t table_size = 1;
+        for (uint64_t v = 0; v < record.num_vars; v++) {
+            // Variables are distinct, sorted vertices of the MRF, and a
+            // declared node keeps its number of states
+            int index = csr.indexOf(vars[v]);
+            if (index < 0 || (v > 0 && vars[v] <= vars[v - 1]) ||
+                ((size_t)index < mrf.nodes.size() && cards[v] != mrf.nodes[index].num_states)) {
+                return fail("corrupt clique record " + std::to_string(i));
+            }
+            if (cards[v] <= 0 || table_size > record.num_values / cards[v]) {
+                return fail("corrupt clique record " + std::to_string(i));
+            }
+            table_size *= cards[v];
+        }
+        if (table_size != record.num_values) {
+            return fail("corrupt clique record " + std::to_string(i));
+        }
+        mrf.cliques.emplace_back(std::vector<int>(vars, vars + record.num_vars),
+                                 std::vector<int>(cards, cards + record.num_vars));
+        const double* values = doubles(record.values_offset);
+        std::copy(values, values + record.num_values, mrf.cliques.back().values.begin());
+    }
+
+    mrf.restoreFrozen(std::move(csr));
+    return true;
+}
@@ -0,0 +1,144 @@
+#ifndef MODEL_BINARY_H
+#define MODEL_BINARY_H
+
+#include "graph.h"
+#include "mrf.h"
+#include "model_parser.h"
+#include <cstdint>
+#include <string>
+
+// Compact binary form of a GraphicalModel and, optionally, the MRF compiled
+// from it. A file is a header, a section table and 64-byte aligned sections,
+// laid out so a mapped file can be read in place:
+//
+//   NODES, MRF_NODES      BinaryNode records
+//   EDGES                 BinaryEdge records
+//   CLIQUES               BinaryClique records
+//   *_CSR_*               frozen adjacency (vertex ids, offsets, neighbors)
+//   NAMES, INTS, FLAGS,   pools the records point into; every buffer in
+//   DOUBLES               DOUBLES starts on a 64-byte boundary
+//
+// Integers are fixed width in the writer's byte order, which the header
+// records. Readers reject other versions and skip sections they do not know.
+
+const uint32_t BINARY_MODEL_VERSION = 1;
+
+enum class BinarySection : uint32_t {
+    NODES = 1,
+    EDGES,
+    CSR_VERTICES,
+    CSR_OFFSETS,
+    CSR_NEIGHBORS,
+    MRF_NODES,
+    CLIQUES,
+    MRF_CSR_VERTICES,
+    MRF_CSR_OFFSETS,
+    MRF_CSR_NEIGHBORS,
+    NAMES,
+    INTS,
+    FLAGS,
+    DOUBLES,
+    COUNT  // One past the last known section
+};
+
+struct BinaryHeader {
+    char magic[8];          // "MRFBIN\0\0"
+    uint32_t version;
+    uint32_t byte_order;    // 0x01020304 as written
+    uint32_t graph_type;    // GraphType of the graphical model
+    uint32_t has_mrf;
+    uint32_t num_sections;
+    uint32_t reserved;
+    uint64_t file_size;
+};
+
+struct BinarySectionEntry {
+    uint32_t id;            // BinarySection
+    uint32_t record_size;
+    uint64_t offset;        // From the start of the file
+    uint64_t count;         // Records
+};
+
+struct BinaryNode {
+    int32_t id;
+    int32_t num_states;
+    uint64_t name_offset;       // NAMES
+    uint64_t name_length;
+    uint64_t potential_offset;  // DOUBLES
+    uint64_t potential_count;
+    uint32_t has_cpt;
+    int32_t cpt_num_states;
+    uint64_t cpt_num_parents;
+    uint64_t cpt_cards_offset;  // INTS, one per parent
+    uint64_t cpt_num_rows;      // 0 if there is no table
+    uint64_t cpt_probs_offset;  // DOUBLES, cpt_num_rows * cpt_num_states
+    uint64_t cpt_rows_offset;   // FLAGS, one per row (DenseCPT::row_set)
+};
+
+struct BinaryEdge {
+    int32_t from;
+    int32_t to;
+    uint32_t directed;
+    uint32_t num_rows;
+    uint64_t row_lengths_offset;  // INTS, one per potential row
+    uint64_t potential_offset;    // DOUBLES, rows back to back
+};
+
+struct BinaryClique {
+    uint64_t vars_offset;    // INTS: num_vars ids followed by num_vars cards
+    uint64_t num_vars;
+    uint64_t values_offset;  // DOUBLES
+    uint64_t num_values;
+};
+
+// Read-only view of a binary model file. open() maps the file and checks the
+// header and section bounds only; loadGraphicalModel and loadMRF then
+// validate the records and copy them, with their pool buffers, into the
+// model or MRF in one pass, after which the mapping is no longer needed.
+class BinaryModelFile {
+public:
+    BinaryModelFile();
+
+    // Problems are reported on std::cerr
+    bool open(const std::string& path);
+    bool isOpen() const { return header != nullptr; }
+    GraphType graphType() const;
+    bool hasMRF() const { return header && header->has_mrf != 0; }
+
+    // Zero-copy access to the records and pools
+    template <typename T>
+    const T* records(BinarySection id, size_t& count) const {
+        size_t s = (size_t)id;
+        count = section_count[s];
+        return reinterpret_cast<const T*>(section_data[s]);
+    }
+    const double* doubles(uint64_t offset) const;
+    const int32_t* ints(uint64_t offset) const;
+    std::string nodeName(const BinaryNode& node) const;
+
+    // Materialize the in-memory models; both come back frozen
+    bool loadGraphicalModel(GraphicalModel& gm) const;
+    bool loadMRF(MRF& mrf) const;
+
+private:
+    MappedFile file;
+    std::string path;
+    const BinaryHeader* header;
+    const char* section_data[(size_t)BinarySection::COUNT];
+    uint64_t section_count[(size_t)BinarySection::COUNT];
+
+    // True if [offset, offset + count) lies inside a pool section
+    bool inPool(BinarySection pool, uint64_t offset, uint64_t count) const;
+    bool loadNode(const BinaryNode& record, Node& node) const;
+    // Fails unless the first vertices are nodes in order and every
+    // neighbor list is strictly increasing
+    bool loadAdjacency(BinarySection vertices, BinarySection offsets, BinarySection neighbors,
+                       const std::vector<Node>& nodes, CSRAdjacency& csr) const;
+    bool fail(const std::string& message) const;
+};
+
+// Write gm, and mrf when given, to path. Returns false if the file could not
+// be written.
+bool saveBinaryModel(const std::string& path, const GraphicalModel& gm, const MRF* mrf);
+
+#endif // MODEL_BINARY_H
@@ -0,0 +1,572 @@
+#include "model_parser.h"
+#include <new>
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ParseError implementation
+ParseError::ParseError(size_t line, size_t column, const std::string& message)
+    : line(line), column(column), message(message) {
+}
+
+std::string ParseError::toString() const {
+    return std::to_string(line) + ":" + std::to_string(column) + ": " + message;
+}
+
+// MappedFile implementation
+MappedFile::MappedFile() : base(nullptr), length(0), mapped(false), is_open(false) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        length = (size_t)st.st_size;
+        if (length == 0) {
+            ::close(fd);
+            is_open = true;
+            return true;
+        }
+        void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (ptr != MAP_FAILED) {
+            madvise(ptr, length, MADV_SEQUENTIAL);
+            base = static_cast<const char*>(ptr);
+            mapped = true;
+            is_open = true;
+            ::close(fd);
+            return true;
+        }
+    }
+
+    // Not mappable: read everything
+    buffer.clear();
+    char chunk[1 << 16];
+    ssize_t got;
+    while ((got = ::read(fd, chunk, sizeof(chunk))) > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + got);
+    }
+    ::close(fd);
+    if (got < 0) {
+        buffer.clear();
+        return false;
+    }
+    base = buffer.data();
+    length = buffer.size();
+    is_open = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped) {
+        munmap(const_cast<char*>(base), length);
+    }
+    buffer.clear();
+    base = nullptr;
+    length = 0;
+    mapped = false;
+    is_open = false;
+}
+
+// Number scanning
+static inline bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+bool scanInt(const char* first, const char* last, int& value) {
+    const char* p = first;
+    bool negative = false;
+    if (p < last && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == last) {
+        return false;
+    }
+    long long result = 0;
+    for (; p < last; p++) {
+        if (!isDigit(*p)) {
+            return false;
+        }
+        result = result * 10 + (*p - '0');
+        if (result > (long long)INT_MAX + 1) {
+            return false;
+        }
+    }
+    if (negative) {
+        result = -result;
+    }
+    if (result > INT_MAX || result < INT_MIN) {
+        return false;
+    }
+    value = (int)result;
+    return true;
+}
+
+// Exact powers of ten representable as doubles
+static const double POW10[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Slow path for tokens the fast path cannot round exactly (very long
+// mantissas, large exponents, inf/nan, hex floats)
+static bool scanDoubleSlow(const char* first, const char* last, double& value) {
+    size_t length = last - first;
+    char small[64];
+    std::string large;
+    const char* text;
+    if (length < sizeof(small)) {
+        std::memcpy(small, first, length);
+        small[length] = '\0';
+        text = small;
+    } else {
+        large.assign(first, last);
+        text = large.c_str();
+    }
+    char* stop = nullptr;
+    double result = std::strtod(text, &stop);
+    if (length == 0 || stop != text + length) {
+        return false;
+    }
+    value = result;
+    return true;
+}
+
+// Fast path: scan a decimal number starting at first and return the end of
+// what was consumed, or nullptr if the value cannot be rounded exactly here
+// (no digits, more than 19 significant digits, exponent beyond 1e+-22)
+static const char* scanDecimal(const char* first, const char* last, double& value) {
+    const char* p = first;
+    bool negative = false;
+    if (p < last && (*p == '+' || *p == '-')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    // Up to 19 significant digits fit in the mantissa exactly
+    uint64_t mantissa = 0;
+    int significant = 0;
+    int exponent = 0;
+    bool any_digits = false;
+    for (; p < last && isDigit(*p); p++) {
+        any_digits = true;
+        if (significant == 19) return nullptr;
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa != 0) significant++;
+    }
+    if (p < last && *p == '.') {
+        for (p++; p < last && isDigit(*p); p++) {
+            any_digits = true;
+            if (significant == 19) return nullptr;
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa != 0) significant++;
+            exponent--;
+        }
+    }
+    if (!any_digits) {
+        return nullptr;
+    }
+    if (p < last && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exp_negative = false;
+        if (p < last && (*p == '+' || *p == '-')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        if (p == last || !isDigit(*p)) {
+            return nullptr;
+        }
+        int exp_value = 0;
+        for (; p < last && isDigit(*p); p++) {
+            if (exp_value < 100000) exp_value = exp_value * 10 + (*p - '0');
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    // Exact mantissa and power of ten: one correctly rounded operation
+    if (mantissa > ((uint64_t)1 << 53) || exponent < -22 || exponent > 22) {
+        return nullptr;
+    }
+    double result = (double)mantissa;
+    result = exponent < 0 ? result / POW10[-exponent] : result * POW10[exponent];
+    value = negative ? -result : result;
+    return p;
+}
+
+bool scanDouble(const char* first, const char* last, double& value) {
+    if (scanDecimal(first, last, value) == last) {
+        return true;
+    }
+    return scanDoubleSlow(first, last, value);
+}
+
+// LineScanner implementation
+LineScanner::LineScanner(const char* line_begin, const char* line_end)
+    : begin(line_begin), cur(line_begin), end(line_end) {
+}
+
+const char* LineScanner::tokenEnd() const {
+    const char* p = cur;
+    while (p < end && !isSpace(*p)) {
+        p++;
+    }
+    return p;
+}
+
+bool LineScanner::nextWord(const char*& token, size_t& length) {
+    if (atEnd()) {
+        return false;
+    }
+    const char* stop = tokenEnd();
+    token = cur;
+    length = stop - cur;
+    cur = stop;
+    return true;
+}
+
+bool LineScanner::nextInt(int& value) {
+    if (atEnd()) {
+        return false;
+    }
+    const char* stop = tokenEnd();
+    if (!scanInt(cur, stop, value)) {
+        return false;
+    }
+    cur = stop;
+    return true;
+}
+
+bool LineScanner::nextDouble(double& value) {
+    if (atEnd()) {
+        return false;
+    }
+    // Plain decimals are scanned while the token is being delimited
+    const char* stop = scanDecimal(cur, end, value);
+    if (stop && (stop == end || isSpace(*stop))) {
+        cur = stop;
+        return true;
+    }
+    stop = tokenEnd();
+    if (!scanDouble(cur, stop, value)) {
+        return false;
+    }
+    cur = stop;
+    return true;
+}
+
+// Chunk records
+static bool isKeyword(const char* token, size_t length, const char* keyword) {
+    return length == std::strlen(keyword) && std::memcmp(token, keyword, length) == 0;
+}
+
+enum class RecordKind {
+    NODE,
+    EDGE,
+    TYPE
+};
+
+// A NODE, EDGE or TYPE line, replayed in file order when merging
+class ModelRecord {
+public:
+    RecordKind kind;
+    int first;          // NODE: id, EDGE: from
+    int second;         // NODE: number of states, EDGE: to
+    bool directed;      // EDGE and TYPE
+    const char* name;   // NODE: name, pointing into the input
+    size_t name_length;
+};
+
+// A CPT line; its numbers live in the owning chunk's value buffer
+class CPTRecord {
+public:
+    int node_id;
+    size_t first_value;
+    size_t num_values;
+    size_t line;    // Relative to the chunk
+    size_t column;  // Of the node id
+};
+
+class ParseChunk {
+public:
+    const char* begin;
+    const char* end;
+    std::vector<ModelRecord> records;
+    std::vector<CPTRecord> cpts;
+    std::vector<double> values;
+    std::vector<ParseError> errors;  // Lines relative to the chunk
+    size_t lines;
+    size_t num_nodes;
+    size_t num_edges;
+
+    ParseChunk() : begin(nullptr), end(nullptr), lines(0), num_nodes(0), num_edges(0) {}
+    void parse();
+
+private:
+    void error(size_t column, const std::string& message);
+    void parseLine(LineScanner& scanner);
+    void parseCPT(LineScanner& scanner);
+};
+
+void ParseChunk::error(size_t column, const std::string& message) {
+    errors.emplace_back(lines, column, message);
+}
+
+void ParseChunk::parse() {
+    const char* cur = begin;
+    while (cur < end) {
+        const char* eol = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+        if (!eol) {
+            eol = end;
+        }
+        lines++;
+        LineScanner scanner(cur, eol);
+        // Blank and '#' comment lines
+        if (!scanner.atEnd()) {
+            parseLine(scanner);
+        }
+        if (eol == end) {
+            break;
+        }
+        cur = eol + 1;
+    }
+}
+
+void ParseChunk::parseLine(LineScanner& scanner) {
+    size_t column = scanner.column();
+    const char* command = nullptr;
+    size_t length = 0;
+    scanner.nextWord(command, length);
+
+    ModelRecord record = ModelRecord();
+    if (isKeyword(command, length, "NODE")) {
+        record.kind = RecordKind::NODE;
+        record.second = 2;
+        if (!scanner.nextInt(record.first)) {
+            error(scanner.column(), "NODE expects an integer node id");
+            return;
+        }
+        if (!scanner.nextWord(record.name, record.name_length)) {
+            error(scanner.column(), "NODE expects a name");
+            return;
+        }
+        if (!scanner.atEnd() && (!scanner.nextInt(record.second) || record.second < 1)) {
+            error(scanner.column(), "NODE expects a positive number of states");
+            return;
+        }
+        num_nodes++;
+    } else if (isKeyword(command, length, "EDGE")) {
+        record.kind = RecordKind::EDGE;
+        if (!scanner.nextInt(record.first) || !scanner.nextInt(record.second)) {
+            error(scanner.column(), "EDGE expects two integer node ids");
+            return;
+        }
+        const char* dir;
+        size_t dir_length;
+        record.directed = scanner.nextWord(dir, dir_length) && isKeyword(dir, dir_length, "directed");
+        num_edges++;
+    } else if (isKeyword(command, length, "TYPE")) {
+        record.kind = RecordKind::TYPE;
+        const char* type;
+        size_t type_length;
+        if (!scanner.nextWord(type, type_length)) {
+            error(scanner.column(), "TYPE expects directed or undirected");
+            return;
+        }
+        record.directed = isKeyword(type, type_length, "directed");
+    } else if (isKeyword(command, length, "CPT")) {
+        parseCPT(scanner);
+        return;
+    } else {
+        error(column, "unknown command '" + std::string(command, length) + "'");
+        return;
+    }
+    records.push_back(record);
+}
+
+// CPT <node_id> [parent_states...] <prob_state0> <prob_state1> ...
+// Format examples:
+//   CPT 0 0.8 0.2                    (root node, no parents)
+//   CPT 2 0 0 0.99 0.01             (node 2 with parents in state 0,0)
+//   CPT 2 0 1 0.9 0.1 1 0 0.8 0.2   (several rows on one line)
+void ParseChunk::parseCPT(LineScanner& scanner) {
+    CPTRecord record;
+    if (!scanner.nextInt(record.node_id)) {
+        error(scanner.column(), "Invalid CPT command, missing node_id");
+        return;
+    }
+    record.line = lines;
+    record.column = scanner.column();
+    record.first_value = values.size();
+    while (!scanner.atEnd()) {
+        double value;
+        if (!scanner.nextDouble(value)) {
+            error(scanner.column(), "CPT expects numeric values");
+            values.resize(record.first_value);
+            return;
+        }
+        values.push_back(value);
+    }
+    record.num_values = values.size() - record.first_value;
+    cpts.push_back(record);
+}
+
+// Split [begin, end) into about `pieces` slices that end on line boundaries
+static std::vector<const char*> splitLines(const char* begin, const char* end, size_t pieces) {
+    std::vector<const char*> bounds(1, begin);
+    size_t target = (end - begin) / pieces;
+    for (size_t k = 1; k < pieces; k++) {
+        const char* p = begin + k * target;
+        if (p <= bounds.back()) continue;
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', end - p));
+        if (!eol) break;
+        if (eol + 1 < end) {
+            bounds.push_back(eol + 1);
+        }
+    }
+    bounds.push_back(end);
+    return bounds;
+}
+
+// Slices smaller than this are not worth a thread
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+// ModelParser implementation
+ModelParser::ModelParser() : num_threads(0) {
+}
+
+void ModelParser::setThreads(size_t num_threads) {
+    this->num_threads = num_threads;
+}
+
+bool ModelParser::parse(const char* begin, const char* end, GraphicalModel& gm) {
+    errors.clear();
+
+    // Several slices per thread so uneven lines still balance
+    size_t threads = num_threads > 0 ? num_threads : ThreadPool::hardwareThreads();
+    size_t pieces = std::min(threads * 4, (size_t)(end - begin) / MIN_CHUNK_BYTES);
+    if (threads <= 1 || pieces < 2) {
+        pieces = 1;
+    }
+    std::vector<const char*> bounds = splitLines(begin, end, pieces);
+    std::vector<ParseChunk> chunks(bounds.size() - 1);
+    for (size_t k = 0; k < chunks.size(); k++) {
+        chunks[k].begin = bounds[k];
+        chunks[k].end = bounds[k + 1];
+    }
+    try {
+        if (chunks.size() > 1) {
+            ThreadPool pool(std::min(threads, chunks.size()));
+            pool.parallelFor(chunks.size(), [&chunks](size_t k) { chunks[k].parse(); });
+        } else {
+            chunks[0].parse();
+        }
+    } catch (const std::bad_alloc&) {
+        // Nothing has been added to gm yet
+        errors.emplace_back(1, 1, "out of memory while tokenizing, model not loaded");
+        return false;
+    }
+
+    // Replay the structure in file order
+    size_t num_nodes = 0;
+    size_t num_edges = 0;
+    for (const auto& chunk : chunks) {
+        num_nodes += chunk.num_nodes;
+        num_edges += chunk.num_edges;
+    }
+    gm.reserve(gm.nodes.size() + num_nodes, gm.edges.size() + num_edges);
+    std::vector<size_t> first_lines(chunks.size(), 0);
+    size_t line = 0;
+    for (size_t k = 0; k < chunks.size(); k++) {
+        first_lines[k] = line;
+        line += chunks[k].lines;
+        for (const auto& err : chunks[k].errors) {
+            errors.emplace_back(err.line + first_lines[k], err.column, err.message);
+        }
+        for (const auto& record : chunks[k].records) {
+            switch (record.kind) {
+                case RecordKind::NODE:
+                    gm.addNode(record.first, std::string(record.name, record.name_length), record.second);
+                    break;
+                case RecordKind::EDGE:
+                    gm.addEdge(record.first, record.second, record.directed);
+                    break;
+                case RecordKind::TYPE:
+                    gm.type = record.directed ? GraphType::DIRECTED : GraphType::UNDIRECTED;
+                    break;
+            }
+        }
+        std::vector<ModelRecord>().swap(chunks[k].records);
+    }
+
+    // Parents are final now, so CPT rows can be placed
+    for (size_t k = 0; k < chunks.size(); k++) {
+        resolveCPTs(chunks[k], first_lines[k], gm);
+    }
+
+    std::stable_sort(errors.begin(), errors.end(), [](const ParseError& a, const ParseError& b) {
+        return a.line != b.line ? a.line < b.line : a.column < b.column;
+    });
+    return errors.empty();
+}
+
+void ModelParser::resolveCPTs(ParseChunk& chunk, size_t first_line, GraphicalModel& gm) {
+    for (const CPTRecord& record : chunk.cpts) {
+        size_t line = first_line + record.line;
+        int node_id = record.node_id;
+        Node* node = gm.getNode(node_id);
+        if (!node) {
+            errors.emplace_back(line, record.column,
+                                "CPT specified for non-existent node " + std::to_string(node_id));
+            continue;
+        }
+
+        // Parents come from the cached family index, in declaration order
+        std::pair<const int*, const int*> parents = gm.parentRange(node_id);
+        size_t num_parents = parents.second - parents.first;
+        if (num_parents == 0) {
+            // Root node: just probabilities
+            if (record.num_values != (size_t)node->num_states) {
+                errors.emplace_back(line, record.column,
+                                    "CPT for root node " + std::to_string(node_id) + " should have " +
+                                    std::to_string(node->num_states) + " values, got " +
+                                    std::to_string(record.num_values));
+                continue;
+            }
+        } else {
+            // Each entry has num_parents parent states + num_states probabilities
+            size_t entry_size = num_parents + node->num_states;
+            if (record.num_values % entry_size != 0) {
+                errors.emplace_back(line, record.column,
+                                    "CPT for node " + std::to_string(node_id) +
+                                    " has incorrect number of values. Expected multiple of " +
+                                    std::to_string(entry_size) + ", got " +
+                                    std::to_string(record.num_values));
+                continue;
+            }
+        }
+        // Rows go straight into the dense table and merge with rows from
+        // earlier CPT lines for the same node
+        if (!gm.loadCPTRows(node_id, chunk.values.data() + record.first_value, record.num_values)) {
+            errors.emplace_back(line, record.column,
+                                "CPT for node " + std::to_string(node_id) +
+                                " has parent states out of range, skipped those rows");
+        }
+    }
+    std::vector<double>().swap(chunk.values);
+}
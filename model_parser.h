@@ -0,0 +1,109 @@
+#ifndef MODEL_PARSER_H
+#define MODEL_PARSER_H
+
+#include "graph.h"
+#include <vector>
+#include <string>
+#include <cstddef>
+
+// Diagnostic tied to a position in the input (1-based line and column)
+class ParseError {
+public:
+    size_t line;
+    size_t column;
+    std::string message;
+
+    ParseError(size_t line, size_t column, const std::string& message);
+    std::string toString() const;  // "line:column: message"
+};
+
+// Read-only contents of a whole file. Regular files are memory-mapped;
+// anything that cannot be mapped (pipes, special files) is read into memory.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return is_open; }
+    const char* data() const { return base; }
+    size_t size() const { return length; }
+
+private:
+    const char* base;
+    size_t length;
+    bool mapped;
+    bool is_open;
+    std::vector<char> buffer;  // Fallback storage when not mapped
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+inline bool isSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Cursor over the tokens of one line. Tokens are whitespace separated and a
+// token starting with '#' comments out the rest of the line. Numbers are
+// scanned in place, without copying the token.
+class LineScanner {
+public:
+    LineScanner(const char* line_begin, const char* line_end);
+
+    // Skip whitespace; true at the end of the line or at a comment
+    bool atEnd() {
+        while (cur < end && isSpace(*cur)) {
+            cur++;
+        }
+        return cur == end || *cur == '#';
+    }
+    // Each returns false, without consuming, if the next token is missing
+    // or malformed
+    bool nextWord(const char*& token, size_t& length);
+    bool nextInt(int& value);
+    bool nextDouble(double& value);
+    size_t column() const { return (size_t)(cur - begin) + 1; }
+
+private:
+    const char* begin;
+    const char* cur;
+    const char* end;
+
+    const char* tokenEnd() const;
+};
+
+// Scan a whole token as a number (from_chars style, no locale, no copy).
+// Both return false unless all of [first, last) is consumed.
+bool scanInt(const char* first, const char* last, int& value);
+bool scanDouble(const char* first, const char* last, double& value);
+
+class ParseChunk;  // Records parsed from one slice of the input
+
+// Parser for the NODE/EDGE/TYPE/CPT model format. The input is split at line
+// boundaries and the slices are tokenized in parallel into per-chunk record
+// buffers. NODE, EDGE and TYPE records are then replayed in file order, so
+// the model does not depend on the thread count, and CPT records are
+// resolved last, once every edge (and so every parent) is known.
+class ModelParser {
+public:
+    ModelParser();
+
+    // Threads used for tokenizing; 0 (the default) uses every hardware thread
+    void setThreads(size_t num_threads);
+
+    // Parse [begin, end) into gm. Malformed lines are reported and skipped;
+    // returns false if any diagnostics were produced. Diagnostics are sorted
+    // by position.
+    bool parse(const char* begin, const char* end, GraphicalModel& gm);
+    const std::vector<ParseError>& getErrors() const { return errors; }
+
+private:
+    std::vector<ParseError> errors;
+    size_t num_threads;
+
+    void resolveCPTs(ParseChunk& chunk, size_t first_line, GraphicalModel& gm);
+};
+
+#endif // MODEL_PARSER_H
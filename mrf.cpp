@@ -1,44 +1,41 @@
 #include "mrf.h"
 #include "graph.h"
+#include "factor_ops.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <unordered_set>
+#include <functional>
+#include <utility>
 
 // Clique implementation
-Clique::Clique(const std::vector<int>& nodes) : nodes(nodes) {
-    // Calculate potential table size
-    int size = 1;
-    for (size_t i = 0; i < nodes.size(); i++) {
-        size *= 2;  // Assuming binary states for now
-    }
-    potential.resize(size, 1.0);
+Clique::Clique(const std::vector<int>& nodes, const std::vector<int>& cards)
+    : Factor(nodes, cards, 1.0) {
 }
 
 void Clique::setPotential(const std::vector<double>& pot) {
-    potential = pot;
-}
-
-int Clique::getPotentialIndex(const std::vector<int>& states) const {
-    int index = 0;
-    int multiplier = 1;
-    for (int i = nodes.size() - 1; i >= 0; i--) {
-        index += states[i] * multiplier;
-        multiplier *= 2;
-    }
-    return index;
+    setValues(pot);
 }
 
 // MRF implementation
-MRF::MRF() {
+MRF::MRF() : frozen(false) {
 }
 
 void MRF::addNode(int id, const std::string& name, int num_states) {
+    thawAdjacency();
     nodes.emplace_back(id, name, num_states);
-    adjacency_list[id] = std::set<int>();
+    node_index.insert(id, (int)nodes.size() - 1);
+    adjacency_list[id] = NeighborSet();
 }
 
 void MRF::addClique(const std::vector<int>& nodes) {
-    cliques.emplace_back(nodes);
+    thawAdjacency();
+    std::vector<int> cards;
+    for (int id : nodes) {
+        const Node* node = getNode(id);
+        cards.push_back(node ? node->num_states : 2);
+    }
+    cliques.emplace_back(nodes, cards);
     // Update adjacency list
     for (size_t i = 0; i < nodes.size(); i++) {
         for (size_t j = i + 1; j < nodes.size(); j++) {
@@ -54,6 +51,58 @@ void MRF::setCliquePotential(int clique_idx, const std::vector<double>& potentia
     }
 }
 
+Node* MRF::getNode(int id) {
+    int pos = node_index.find(id);
+    return pos >= 0 ? &nodes[pos] : nullptr;
+}
+
+const Node* MRF::getNode(int id) const {
+    int pos = node_index.find(id);
+    return pos >= 0 ? &nodes[pos] : nullptr;
+}
+
+void MRF::freezeAdjacency() {
+    if (frozen) {
+        return;
+    }
+    csr = buildAdjacency();
+    adjacency_list.clear();
+    frozen = true;
+}
+
+void MRF::restoreFrozen(CSRAdjacency&& adjacency) {
+    node_index.clear();
+    adjacency_list.clear();
+    for (size_t i = 0; i < nodes.size(); i++) {
+        node_index.insert(nodes[i].id, (int)i);
+    }
+    csr = std::move(adjacency);
+    frozen = true;
+}
+
+void MRF::thawAdjacency() {
+    if (!frozen) {
+        return;
+    }
+    adjacency_list = csr.toAdjacencyList();
+    csr.clear();
+    frozen = false;
+}
+
+CSRAdjacency MRF::buildAdjacency() const {
+    if (frozen) {
+        return csr;
+    }
+    std::vector<int> ids;
+    ids.reserve(nodes.size());
+    for (const auto& node : nodes) {
+        ids.push_back(node.id);
+    }
+    CSRAdjacency adjacency;
+    adjacency.build(ids, adjacency_list);
+    return adjacency;
+}
+
 void MRF::print() const {
     std::cout << "Markov Random Field (MRF)\n";
     std::cout << "Nodes:\n";
@@ -64,9 +113,9 @@ void MRF::print() const {
     std::cout << "Cliques:\n";
     for (size_t i = 0; i < cliques.size(); i++) {
         std::cout << "  Clique " << i << ": {";
-        for (size_t j = 0; j < cliques[i].nodes.size(); j++) {
-            std::cout << cliques[i].nodes[j];
-            if (j < cliques[i].nodes.size() - 1) std::cout << ", ";
+        for (size_t j = 0; j < cliques[i].vars.size(); j++) {
+            std::cout << cliques[i].vars[j];
+            if (j < cliques[i].vars.size() - 1) std::cout << ", ";
         }
         std::cout << "}\n";
     }
@@ -80,30 +129,143 @@ int MRF::getTotalStates() const {
     return total;
 }
 
-// Convert directed graph to MRF by moralization
-void moralizeGraph(GraphicalModel& gm) {
+// Undirected CSR over nodes and the links each_link reports (it is called
+// with a visitor, once per pass), laid out as CSRAdjacency::build lays out
+// the equivalent adjacency map: nodes first, in order, then ids that only
+// appear in links. Those are numbered in the order the map reaches them, so
+// link sets that have any take the map route.
+static CSRAdjacency linkAdjacency(const std::vector<Node>& nodes,
+                                  const std::function<void(const std::function<void(int, int)>&)>& each_link) {
+    IdIndex local;
+    std::vector<int> ids;
+    ids.reserve(nodes.size());
+    for (const auto& node : nodes) {
+        if (local.find(node.id) < 0) {
+            local.insert(node.id, (int)ids.size());
+            ids.push_back(node.id);
+        }
+    }
+    
+    bool declared = true;
+    each_link([&](int from, int to) {
+        declared = declared && local.find(from) >= 0 && local.find(to) >= 0;
+    });
+    CSRAdjacency adjacency;
+    if (!declared) {
+        AdjacencyMap links;
+        for (int id : ids) links[id];
+        each_link([&](int from, int to) {
+            links[from].insert(to);
+            links[to].insert(from);
+        });
+        adjacency.build(ids, links);
+        return adjacency;
+    }
+    
+    // Count, scatter both directions (a self-loop once), then sort and
+    // drop repeated links in place
+    size_t n = ids.size();
+    std::vector<uint64_t> offsets(n + 1, 0);
+    each_link([&](int from, int to) {
+        int u = local.find(from), v = local.find(to);
+        offsets[u + 1]++;
+        if (u != v) offsets[v + 1]++;
+    });
+    for (size_t v = 0; v < n; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<int> neighbors(offsets[n]);
+    std::vector<uint64_t> fill(offsets.begin(), offsets.end() - 1);
+    each_link([&](int from, int to) {
+        int u = local.find(from), v = local.find(to);
+        neighbors[fill[u]++] = v;
+        if (u != v) neighbors[fill[v]++] = u;
+    });
+    
+    size_t out = 0, begin = 0;
+    for (size_t v = 0; v < n; v++) {
+        size_t end = offsets[v + 1];
+        std::sort(neighbors.begin() + begin, neighbors.begin() + end);
+        size_t start = out;
+        for (size_t i = begin; i < end; i++) {
+            if (out == start || neighbors[out - 1] != neighbors[i]) {
+                neighbors[out++] = neighbors[i];
+            }
+        }
+        begin = end;
+        offsets[v] = start;
+    }
+    offsets[n] = out;
+    adjacency.assign(ids.data(), n, offsets.data(), neighbors.data());
+    return adjacency;
+}
+
+// gm's edges plus extra links, as if every edge were undirected
+static CSRAdjacency undirectedAdjacency(const GraphicalModel& gm,
+                                        const std::vector<std::pair<int, int>>& extra) {
+    return linkAdjacency(gm.nodes, [&](const std::function<void(int, int)>& link) {
+        for (const auto& edge : gm.edges) link(edge.from, edge.to);
+        for (const auto& pair : extra) link(pair.first, pair.second);
+    });
+}
+
+MoralOverlay::MoralOverlay() {
+}
+
+MoralOverlay::MoralOverlay(const GraphicalModel& gm, const CSRAdjacency& linked) {
     if (gm.type != GraphType::DIRECTED) {
-        return;  // Already undirected
+        return;
     }
     
-    // For each node, connect all its parents (moralization)
+    // For each node, connect all its parents (moralization). The parent
+    // index is built once, so the whole pass is O(E + fill edges).
+    std::unordered_set<uint64_t> pending;
+    std::vector<int> parent_local;
     for (const auto& node : gm.nodes) {
-        std::vector<int> parents;
-        for (const auto& edge : gm.edges) {
-            if (edge.to == node.id && edge.directed) {
-                parents.push_back(edge.from);
-            }
+        std::pair<const int*, const int*> parents = gm.parentRange(node.id);
+        parent_local.clear();
+        for (const int* p = parents.first; p != parents.second; ++p) {
+            parent_local.push_back(linked.indexOf(*p));
         }
         
         // Add edges between all pairs of parents
-        for (size_t i = 0; i < parents.size(); i++) {
-            for (size_t j = i + 1; j < parents.size(); j++) {
-                if (!gm.hasEdge(parents[i], parents[j])) {
-                    gm.addEdge(parents[i], parents[j], false);
+        for (size_t i = 0; i < parent_local.size(); i++) {
+            int pi = parent_local[i];
+            for (size_t j = i + 1; j < parent_local.size(); j++) {
+                int pj = parent_local[j];
+                if (linked.hasEdge(pi, pj)) {
+                    continue;
+                }
+                uint64_t key = pi < pj ? ((uint64_t)pi << 32) | (uint32_t)pj
+                                       : ((uint64_t)pj << 32) | (uint32_t)pi;
+                if (pending.insert(key).second) {
+                    fill_edges.emplace_back(parents.first[i], parents.first[j]);
                 }
             }
         }
     }
+}
+
+MoralGraphView::MoralGraphView(const GraphicalModel& gm)
+    : model(gm), adjacency(undirectedAdjacency(gm, std::vector<std::pair<int, int>>())) {
+    overlay = MoralOverlay(gm, adjacency);
+    if (!overlay.fill_edges.empty()) {
+        adjacency = undirectedAdjacency(gm, overlay.fill_edges);
+    }
+}
+
+// Convert directed graph to MRF by moralization
+void moralizeGraph(GraphicalModel& gm) {
+    if (gm.type != GraphType::DIRECTED) {
+        return;  // Already undirected
+    }
+    
+    // The view's adjacency is exactly the frozen form of the result
+    MoralGraphView moral(gm);
+    gm.edges.reserve(gm.edges.size() + moral.overlay.fill_edges.size());
+    for (const auto& fill : moral.overlay.fill_edges) {
+        gm.edges.emplace_back(fill.first, fill.second, false);
+    }
     
     // Make all edges undirected
     for (auto& edge : gm.edges) {
@@ -111,214 +273,694 @@ void moralizeGraph(GraphicalModel& gm) {
     }
     
     gm.type = GraphType::UNDIRECTED;
+    // Undirected edges are now reachable from both endpoints
+    gm.restoreFrozen(std::move(moral.adjacency));
 }
 
-// Find maximal cliques (simplified version)
-std::vector<Clique> findMaximalCliques(const GraphicalModel& gm) {
-    std::vector<Clique> cliques;
+// Binary min-heap over vertices 0..n-1 with a position table, so the key of
+// any vertex can be changed in O(log n)
+class IndexedMinHeap {
+public:
+    explicit IndexedMinHeap(int n) : position(n, -1), key(n, std::make_pair(0LL, 0LL)) {
+    }
     
-    // Simple approach: each edge forms a 2-clique, and we find larger cliques
-    // For a more complete implementation, use Bron-Kerbosch algorithm
+    bool empty() const { return heap.empty(); }
+    bool contains(int v) const { return position[v] >= 0; }
     
-    // For each node, try to form cliques with its neighbors
-    std::set<std::set<int>> clique_sets;
+    void push(int v, std::pair<long long, long long> k) {
+        key[v] = k;
+        position[v] = (int)heap.size();
+        heap.push_back(v);
+        siftUp(position[v]);
+    }
     
-    for (const auto& node : gm.nodes) {
-        std::vector<int> neighbors = gm.getNeighbors(node.id);
-        
-        // Add single-node clique
-        clique_sets.insert({node.id});
-        
-        // Add 2-cliques (edges)
-        for (int neighbor : neighbors) {
-            if (node.id < neighbor) {  // Avoid duplicates
-                clique_sets.insert({node.id, neighbor});
+    int pop() {
+        int top = heap[0];
+        swapAt(0, (int)heap.size() - 1);
+        heap.pop_back();
+        position[top] = -1;
+        if (!heap.empty()) siftDown(0);
+        return top;
+    }
+    
+    void update(int v, std::pair<long long, long long> k) {
+        if (!contains(v)) return;
+        std::pair<long long, long long> old = key[v];
+        key[v] = k;
+        if (k < old) siftUp(position[v]);
+        else siftDown(position[v]);
+    }
+
+private:
+    std::vector<int> heap;
+    std::vector<int> position;
+    std::vector<std::pair<long long, long long>> key;
+    
+    void swapAt(int i, int j) {
+        std::swap(heap[i], heap[j]);
+        position[heap[i]] = i;
+        position[heap[j]] = j;
+    }
+    
+    void siftUp(int i) {
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!(key[heap[i]] < key[heap[parent]])) break;
+            swapAt(i, parent);
+            i = parent;
+        }
+    }
+    
+    void siftDown(int i) {
+        int n = (int)heap.size();
+        while (true) {
+            int smallest = i;
+            int left = 2 * i + 1, right = left + 1;
+            if (left < n && key[heap[left]] < key[heap[smallest]]) smallest = left;
+            if (right < n && key[heap[right]] < key[heap[smallest]]) smallest = right;
+            if (smallest == i) break;
+            swapAt(i, smallest);
+            i = smallest;
+        }
+    }
+};
+
+TriangulationResult::TriangulationResult()
+    : fill_edges(0), treewidth(-1), total_table_size(0.0) {
+}
+
+void TriangulationResult::print() const {
+    std::cout << "Triangulation\n";
+    std::cout << "  Fill edges: " << fill_edges << "\n";
+    std::cout << "  Maximal cliques: " << cliques.size() << "\n";
+    std::cout << "  Treewidth: " << treewidth << "\n";
+    std::cout << "  Total clique-table size: " << total_table_size << " entries\n";
+}
+
+void triangulateGraph(GraphicalModel& gm) {
+    triangulateGraph(gm, EliminationHeuristic::MIN_FILL);
+}
+
+// Greedy elimination with exact, incrementally maintained scores. Adding a
+// fill edge (a, b) lowers the fill of every common neighbor by one and
+// raises fill(a) by deg(a) - common (likewise for b); removing v afterwards
+// lowers fill(w) by deg(w) - deg(v) for each neighbor w, since N(v) is a
+// clique by then. Only the touched vertices are re-keyed in the heap.
+TriangulationResult triangulateGraph(GraphicalModel& gm, EliminationHeuristic heuristic) {
+    TriangulationResult result;
+    if (gm.type == GraphType::DIRECTED) {
+        moralizeGraph(gm);
+    }
+    gm.freezeAdjacency();
+    CSRAdjacency adj = gm.csr.symmetrized();
+    int n = (int)adj.numVertices();
+    
+    std::vector<std::vector<int>> neighbors(n);
+    for (int v = 0; v < n; v++) {
+        neighbors[v].assign(adj.neighborsBegin(v), adj.neighborsEnd(v));
+    }
+    std::vector<double> cards(n, 2.0);
+    for (int v = 0; v < n; v++) {
+        const Node* node = gm.getNode(adj.vertex_ids[v]);
+        if (node) cards[v] = node->num_states;
+    }
+    
+    // Initial fill: neighbor pairs minus the edges among the neighbors
+    bool min_fill = heuristic == EliminationHeuristic::MIN_FILL;
+    std::vector<long long> fill(n, 0);
+    if (min_fill) {
+        std::vector<char> mark(n, 0);
+        for (int v = 0; v < n; v++) {
+            long long d = (long long)neighbors[v].size();
+            long long linked = 0;
+            for (int u : neighbors[v]) mark[u] = 1;
+            for (int u : neighbors[v]) {
+                for (int x : neighbors[u]) linked += mark[x];
             }
+            for (int u : neighbors[v]) mark[u] = 0;
+            fill[v] = d * (d - 1) / 2 - linked / 2;
         }
+    }
+    
+    auto score = [&](int v) {
+        long long degree = (long long)neighbors[v].size();
+        return min_fill ? std::make_pair(fill[v], degree) : std::make_pair(degree, (long long)v);
+    };
+    IndexedMinHeap heap(n);
+    for (int v = 0; v < n; v++) {
+        heap.push(v, score(v));
+    }
+    
+    std::vector<std::pair<int, int>> added;
+    std::vector<int> position(n, -1);
+    std::vector<std::vector<int>> later(n);  // Remaining neighbors at elimination
+    std::vector<int> touched;
+    std::vector<char> is_touched(n, 0);
+    auto touch = [&](int v) {
+        if (!is_touched[v]) {
+            is_touched[v] = 1;
+            touched.push_back(v);
+        }
+    };
+    
+    for (int step = 0; step < n; step++) {
+        int v = heap.pop();
+        position[v] = step;
+        const std::vector<int> nv = neighbors[v];
+        later[v] = nv;
         
-        // Try to extend to 3-cliques
-        for (size_t i = 0; i < neighbors.size(); i++) {
-            for (size_t j = i + 1; j < neighbors.size(); j++) {
-                int n1 = neighbors[i];
-                int n2 = neighbors[j];
-                if (gm.hasEdge(n1, n2)) {
-                    std::set<int> clique = {node.id, n1, n2};
-                    clique_sets.insert(clique);
+        // Connect the remaining neighbors of v pairwise
+        for (size_t i = 0; i < nv.size(); i++) {
+            for (size_t j = i + 1; j < nv.size(); j++) {
+                int a = nv[i], b = nv[j];
+                std::vector<int>& na = neighbors[a];
+                std::vector<int>& nb = neighbors[b];
+                if (std::binary_search(na.begin(), na.end(), b)) continue;
+                if (min_fill) {
+                    int common = 0;
+                    size_t x = 0, y = 0;
+                    while (x < na.size() && y < nb.size()) {
+                        if (na[x] < nb[y]) x++;
+                        else if (nb[y] < na[x]) y++;
+                        else {
+                            fill[na[x]]--;
+                            touch(na[x]);
+                            common++;
+                            x++;
+                            y++;
+                        }
+                    }
+                    fill[a] += (long long)na.size() - common;
+                    fill[b] += (long long)nb.size() - common;
                 }
+                na.insert(std::lower_bound(na.begin(), na.end(), b), b);
+                nb.insert(std::lower_bound(nb.begin(), nb.end(), a), a);
+                added.emplace_back(a, b);
+            }
+        }
+        
+        // Remove v from the graph
+        for (int w : nv) {
+            std::vector<int>& nw = neighbors[w];
+            if (min_fill) {
+                fill[w] -= (long long)nw.size() - (long long)nv.size();
             }
+            nw.erase(std::lower_bound(nw.begin(), nw.end(), v));
+            touch(w);
+        }
+        neighbors[v].clear();
+        neighbors[v].shrink_to_fit();
+        
+        for (int w : touched) {
+            heap.update(w, score(w));
+            is_touched[w] = 0;
         }
+        touched.clear();
     }
     
-    // Convert to Clique objects
-    for (const auto& clique_set : clique_sets) {
-        std::vector<int> nodes_vec(clique_set.begin(), clique_set.end());
-        cliques.emplace_back(nodes_vec);
+    // C_v = {v} + later(v) is maximal unless some u whose first-eliminated
+    // later neighbor is v has |later(u)| == |later(v)| + 1
+    std::vector<char> absorbed(n, 0);
+    for (int u = 0; u < n; u++) {
+        if (later[u].empty()) continue;
+        int parent = later[u][0];
+        for (int x : later[u]) {
+            if (position[x] < position[parent]) parent = x;
+        }
+        if (later[u].size() == later[parent].size() + 1) {
+            absorbed[parent] = 1;
+        }
     }
     
-    return cliques;
+    std::vector<int> order(n);
+    for (int v = 0; v < n; v++) order[position[v]] = v;
+    for (int v : order) {
+        result.elimination_order.push_back(adj.vertex_ids[v]);
+        result.treewidth = std::max(result.treewidth, (int)later[v].size());
+        if (absorbed[v]) continue;
+        std::vector<int> clique(1, adj.vertex_ids[v]);
+        double table = cards[v];
+        for (int x : later[v]) {
+            clique.push_back(adj.vertex_ids[x]);
+            table *= cards[x];
+        }
+        std::sort(clique.begin(), clique.end());
+        result.cliques.push_back(clique);
+        result.total_table_size += table;
+    }
+    
+    for (const auto& edge : added) {
+        gm.addEdge(adj.vertex_ids[edge.first], adj.vertex_ids[edge.second], false);
+    }
+    result.fill_edges = added.size();
+    gm.freezeAdjacency();
+    return result;
 }
 
-// Helper function to convert CPT to clique potential
-std::vector<double> convertCPTToPotential(const std::vector<int>& clique_nodes, 
-                                         const GraphicalModel& gm) {
-    // Find which node in the clique has the CPT
-    int cpt_node_id = -1;
-    std::vector<int> parent_ids;
+// Bron-Kerbosch state for one degeneracy-ordered subproblem. The vertices
+// of the subproblem (neighbors of the seed vertex) are renumbered 0..n-1 and
+// all candidate sets are bitsets over that local numbering.
+struct CliqueSearch {
+    size_t words;                        // 64-bit words per bitset
+    std::vector<uint64_t> local_adj;     // n bitsets, row-major
+    std::vector<int> local_ids;          // Local vertex -> node id
+    std::vector<uint64_t> stack;         // P and X bitsets per recursion level
+    std::vector<int> clique;             // Current R as node ids
+    std::vector<std::vector<int>>* out;
+    
+    const uint64_t* row(int v) const { return local_adj.data() + v * words; }
     
-    for (int node_id : clique_nodes) {
-        const Node* n = gm.getNode(node_id);
-        if (n && n->has_cpt) {
-            cpt_node_id = node_id;
-            parent_ids = gm.getParents(node_id);
-            break;
+    void expand(size_t depth) {
+        uint64_t* P = stack.data() + 2 * depth * words;
+        uint64_t* X = P + words;
+        
+        bool p_empty = true, x_empty = true;
+        for (size_t w = 0; w < words; w++) {
+            if (P[w]) p_empty = false;
+            if (X[w]) x_empty = false;
+        }
+        if (p_empty) {
+            if (x_empty) {
+                std::vector<int> found(clique);
+                std::sort(found.begin(), found.end());
+                out->push_back(found);
+            }
+            return;
+        }
+        
+        // Tomita pivot: the vertex of P u X with most neighbors in P
+        int pivot = -1;
+        int best = -1;
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = P[w] | X[w];
+            while (bits) {
+                int u = (int)(w * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+                const uint64_t* nu = row(u);
+                int count = 0;
+                for (size_t k = 0; k < words; k++) {
+                    count += __builtin_popcountll(P[k] & nu[k]);
+                }
+                if (count > best) {
+                    best = count;
+                    pivot = u;
+                }
+            }
         }
+        
+        if (stack.size() < 2 * (depth + 2) * words) {
+            stack.resize(2 * (depth + 2) * words);
+            P = stack.data() + 2 * depth * words;
+            X = P + words;
+        }
+        const uint64_t* np = row(pivot);
+        for (size_t w = 0; w < words; w++) {
+            uint64_t bits = P[w] & ~np[w];
+            while (bits) {
+                int v = (int)(w * 64 + __builtin_ctzll(bits));
+                bits &= bits - 1;
+                const uint64_t* nv = row(v);
+                uint64_t* P_next = stack.data() + 2 * (depth + 1) * words;
+                uint64_t* X_next = P_next + words;
+                for (size_t k = 0; k < words; k++) {
+                    P_next[k] = P[k] & nv[k];
+                    X_next[k] = X[k] & nv[k];
+                }
+                clique.push_back(local_ids[v]);
+                expand(depth + 1);
+                clique.pop_back();
+                // expand() may have grown the stack
+                P = stack.data() + 2 * depth * words;
+                X = P + words;
+                P[w] &= ~(1ULL << (v % 64));
+                X[w] |= 1ULL << (v % 64);
+            }
+        }
+    }
+};
+
+// Vertex order in which each vertex has at most `degeneracy` later
+// neighbors (Matula-Beck bucket queue, O(V + E))
+static std::vector<int> degeneracyOrder(const CSRAdjacency& adj) {
+    int n = (int)adj.numVertices();
+    std::vector<int> degree(n);
+    int max_degree = 0;
+    for (int v = 0; v < n; v++) {
+        degree[v] = adj.degree(v);
+        max_degree = std::max(max_degree, degree[v]);
+    }
+    
+    // Vertices sorted by degree, with bucket starts and positions
+    std::vector<int> bucket_start(max_degree + 2, 0);
+    for (int v = 0; v < n; v++) bucket_start[degree[v] + 1]++;
+    for (int d = 0; d <= max_degree; d++) bucket_start[d + 1] += bucket_start[d];
+    std::vector<int> order(n), position(n);
+    std::vector<int> fill(bucket_start.begin(), bucket_start.end() - 1);
+    for (int v = 0; v < n; v++) {
+        position[v] = fill[degree[v]]++;
+        order[position[v]] = v;
     }
     
-    if (cpt_node_id == -1) {
-        // No CPT found, return uniform potential
-        int size = 1;
-        for (int n : clique_nodes) {
-            const Node* node_ptr = gm.getNode(n);
-            if (node_ptr) size *= node_ptr->num_states;
+    for (int i = 0; i < n; i++) {
+        int v = order[i];
+        for (const int* it = adj.neighborsBegin(v); it != adj.neighborsEnd(v); ++it) {
+            int u = *it;
+            if (position[u] <= i || degree[u] <= degree[v]) continue;
+            // Move u to the front of its bucket, then shrink the bucket
+            int du = degree[u];
+            int front = std::max(bucket_start[du], i + 1);
+            int w = order[front];
+            if (w != u) {
+                std::swap(order[front], order[position[u]]);
+                position[w] = position[u];
+                position[u] = front;
+            }
+            bucket_start[du] = front + 1;
+            degree[u]--;
         }
-        return std::vector<double>(size, 1.0);
     }
+    return order;
+}
+
+// Report every maximal clique that contains v and none of v's neighbors
+// for which in_p(u) is false (those start in X, so cliques through them are
+// left to their own search)
+template <typename InP>
+static void searchCliquesOf(CliqueSearch& search, const CSRAdjacency& adj, int v,
+                            std::vector<int>& local_index, InP in_p) {
+    const int* begin = adj.neighborsBegin(v);
+    const int* end = adj.neighborsEnd(v);
+    int d = (int)(end - begin);
     
-    const Node* cpt_node = gm.getNode(cpt_node_id);
-    if (!cpt_node || !cpt_node->has_cpt) {
-        int size = 1;
-        for (int n : clique_nodes) {
-            const Node* node_ptr = gm.getNode(n);
-            if (node_ptr) size *= node_ptr->num_states;
+    search.words = (d + 63) / 64;
+    search.local_ids.assign(begin, end);
+    for (int k = 0; k < d; k++) local_index[begin[k]] = k;
+    search.local_adj.assign((size_t)d * search.words, 0);
+    for (int k = 0; k < d; k++) {
+        uint64_t* row = search.local_adj.data() + k * search.words;
+        int u = begin[k];
+        for (const int* it = adj.neighborsBegin(u); it != adj.neighborsEnd(u); ++it) {
+            int j = local_index[*it];
+            if (j >= 0) row[j / 64] |= 1ULL << (j % 64);
         }
-        return std::vector<double>(size, 1.0);
     }
     
-    // Build potential table from CPT
-    // The clique contains the node and its parents
-    // We need to map each state combination to the CPT value
+    search.stack.assign(2 * (size_t)std::max<size_t>(search.words, 1) * 2, 0);
+    uint64_t* P = search.stack.data();
+    uint64_t* X = P + search.words;
+    for (int k = 0; k < d; k++) {
+        uint64_t bit = 1ULL << (k % 64);
+        if (in_p(begin[k])) P[k / 64] |= bit;
+        else X[k / 64] |= bit;
+    }
+    for (int k = 0; k < d; k++) {
+        search.local_ids[k] = adj.vertex_ids[begin[k]];
+    }
+    search.clique.assign(1, adj.vertex_ids[v]);
+    search.expand(0);
     
-    // Determine the order of nodes in the clique (node first, then parents)
-    std::vector<int> node_order;
-    node_order.push_back(cpt_node_id);
-    for (int parent_id : parent_ids) {
-        if (std::find(clique_nodes.begin(), clique_nodes.end(), parent_id) != clique_nodes.end()) {
-            node_order.push_back(parent_id);
+    for (int k = 0; k < d; k++) local_index[begin[k]] = -1;
+}
+
+// Enumerate maximal cliques with Bron-Kerbosch, Tomita pivoting and a
+// degeneracy-ordered outer loop (Eppstein-Loffler-Strash). Each clique is
+// reported once, with its nodes sorted by id; cliques are sorted
+// lexicographically for deterministic output.
+std::vector<Clique> findMaximalCliques(const GraphicalModel& gm) {
+    // Walk the frozen CSR directly when available
+    CSRAdjacency local;
+    if (!gm.isFrozen()) {
+        local = gm.buildAdjacency();
+    }
+    const CSRAdjacency& stored = gm.isFrozen() ? gm.csr : local;
+    // Cliques are an undirected notion; directed models need the symmetric view
+    if (gm.type == GraphType::DIRECTED) {
+        return findMaximalCliques(stored.symmetrized(), gm);
+    }
+    return findMaximalCliques(stored, gm);
+}
+
+std::vector<Clique> findMaximalCliques(const CSRAdjacency& adj, const GraphicalModel& gm) {
+    int n = (int)adj.numVertices();
+    std::vector<int> order = degeneracyOrder(adj);
+    std::vector<int> rank(n);
+    for (int i = 0; i < n; i++) rank[order[i]] = i;
+    
+    std::vector<std::vector<int>> found;
+    std::vector<int> local_index(n, -1);
+    CliqueSearch search;
+    search.out = &found;
+    
+    // P = later neighbors, X = earlier neighbors
+    for (int i = 0; i < n; i++) {
+        searchCliquesOf(search, adj, order[i], local_index, [&](int u) { return rank[u] > i; });
+    }
+    
+    // A clique whose table would not fit is replaced by its edges, which
+    // still cover every pairwise factor
+    size_t split = 0;
+    size_t kept = 0;
+    for (size_t c = 0; c < found.size(); c++) {
+        if (!cliqueTableFits(found[c], gm)) {
+            split++;
+            continue;
+        }
+        if (kept != c) found[kept] = std::move(found[c]);
+        kept++;
+    }
+    if (split > 0) {
+        size_t end = found.size();
+        for (size_t c = kept; c < end; c++) {
+            std::vector<int> vars = std::move(found[c]);
+            for (size_t i = 0; i < vars.size(); i++) {
+                for (size_t j = i + 1; j < vars.size(); j++) {
+                    found.push_back({vars[i], vars[j]});
+                }
+            }
         }
+        found.erase(found.begin() + kept, found.begin() + end);
+        std::cerr << "Warning: split " << split << " maximal clique(s) with more than "
+                  << (size_t)MAX_CLIQUE_TABLE_ENTRIES << " table entries into pairwise factors; "
+                  << "factors over three or more of their nodes are dropped\n";
     }
     
-    // Calculate potential table size
-    int potential_size = 1;
-    std::vector<int> node_sizes;
-    for (int n : node_order) {
-        const Node* node_ptr = gm.getNode(n);
-        if (node_ptr) {
-            node_sizes.push_back(node_ptr->num_states);
-            potential_size *= node_ptr->num_states;
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    std::vector<Clique> cliques;
+    cliques.reserve(found.size());
+    std::vector<int> cards;
+    for (const auto& nodes_vec : found) {
+        cards.clear();
+        for (int id : nodes_vec) {
+            const Node* node = gm.getNode(id);
+            cards.push_back(node ? node->num_states : 2);
         }
+        cliques.emplace_back(nodes_vec, cards);
+    }
+    return cliques;
+}
+
+bool cliqueTableFits(const std::vector<int>& vars, const GraphicalModel& gm) {
+    if (vars.size() <= 2) {
+        return true;
+    }
+    double entries = 1.0;
+    for (int id : vars) {
+        const Node* node = gm.getNode(id);
+        entries *= node ? node->num_states : 2;
     }
+    return entries <= MAX_CLIQUE_TABLE_ENTRIES;
+}
+
+std::vector<std::vector<int>> findMaximalCliquesContaining(const CSRAdjacency& adj,
+                                                           const std::vector<int>& vertices) {
+    int n = (int)adj.numVertices();
+    std::vector<char> searched(n, 0);
+    std::vector<std::vector<int>> found;
+    std::vector<int> local_index(n, -1);
+    CliqueSearch search;
+    search.out = &found;
     
-    std::vector<double> potential(potential_size, 1.0);
+    // A clique through several of the vertices belongs to the first one
+    // searched, so later searches keep those vertices in X
+    for (int v : vertices) {
+        if (v < 0 || v >= n || searched[v]) continue;
+        searchCliquesOf(search, adj, v, local_index, [&](int u) { return !searched[u]; });
+        searched[v] = 1;
+    }
+    std::sort(found.begin(), found.end());
+    return found;
+}
+
+// Helper function to convert a node's CPT to a potential over a clique that
+// contains the node and all of its parents. The factor's vars and cards give
+// the clique layout (last node varies fastest); its values are overwritten.
+//
+// The dense CPT is a table over (parents..., node), so each clique variable
+// just gets its stride in it and the potential is a single strided gather.
+// Unset rows contribute 1.0.
+void convertCPTToPotential(int cpt_node_id, Factor& potential, const GraphicalModel& gm) {
+    std::fill(potential.values.begin(), potential.values.end(), 1.0);
+    const Node* cpt_node = gm.getNode(cpt_node_id);
+    if (!cpt_node || !cpt_node->has_cpt || cpt_node->cpt.empty()) {
+        return;
+    }
+    const DenseCPT& cpt = cpt_node->cpt;
+    std::pair<const int*, const int*> parents = gm.parentRange(cpt_node_id);
+    size_t num_parents = parents.second - parents.first;
+    if (!cpt.hasShape(cpt_node->num_states, gm.getParentCards(cpt_node_id))) {
+        std::cerr << "Warning: CPT of node " << cpt_node_id
+                  << " does not match its parents, ignoring it\n";
+        return;
+    }
     
-    // Fill potential table from CPT
-    for (int i = 0; i < potential_size; i++) {
-        // Decode state combination
-        std::vector<int> states;
-        int temp = i;
-        for (int size : node_sizes) {
-            states.push_back(temp % size);
-            temp /= size;
+    // Stride of each clique variable in the CPT; a parent listed twice
+    // contributes both strides
+    std::vector<size_t> linked(potential.vars.size(), 0);
+    for (size_t i = 0; i < potential.vars.size(); i++) {
+        int var = potential.vars[i];
+        if (var == cpt_node_id) {
+            linked[i] += 1;
         }
-        
-        // Get node state (first in order)
-        int node_state = states[0];
-        
-        // Get parent states
-        std::vector<int> parent_states;
-        for (size_t j = 1; j < states.size(); j++) {
-            parent_states.push_back(states[j]);
+        for (size_t p = 0; p < num_parents; p++) {
+            if (parents.first[p] == var) {
+                linked[i] += cpt.strides[p];
+            }
         }
-        
-        // Look up in CPT
-        auto cpt_it = cpt_node->cpt.find(parent_states);
-        if (cpt_it != cpt_node->cpt.end() && node_state < (int)cpt_it->second.size()) {
-            potential[i] = cpt_it->second[node_state];
+    }
+    
+    FactorCursor cursor(potential.cards, linked);
+    for (size_t i = 0; i < potential.values.size(); i++) {
+        potential.values[i] = cpt.probs[cursor.linked()];
+        cursor.next();
+    }
+}
+
+// Index of the first clique containing every node of scope, or -1
+static int findContainingClique(const std::vector<int>& scope, const std::vector<Clique>& cliques,
+                                const std::vector<std::vector<int>>& member_of, const CSRAdjacency& adj) {
+    int v = adj.indexOf(scope[0]);
+    if (v < 0) {
+        return -1;
+    }
+    for (int c : member_of[v]) {
+        const std::vector<int>& nodes = cliques[c].vars;
+        bool contains = true;
+        for (size_t i = 1; i < scope.size() && contains; i++) {
+            contains = std::binary_search(nodes.begin(), nodes.end(), scope[i]);
         }
+        if (contains) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+std::vector<int> nodeFactorScope(const Node& node, const GraphicalModel& gm) {
+    std::vector<int> scope(1, node.id);
+    if (gm.type == GraphType::DIRECTED && node.has_cpt) {
+        std::pair<const int*, const int*> parents = gm.parentRange(node.id);
+        scope.insert(scope.end(), parents.first, parents.second);
+    }
+    return scope;
+}
+
+void multiplyNodeFactor(Clique& clique, const Node& node, const GraphicalModel& gm) {
+    if (node.has_cpt && gm.type == GraphType::DIRECTED) {
+        // Convert CPT to potential
+        Factor factor(clique.vars, clique.cards);
+        convertCPTToPotential(node.id, factor, gm);
+        factorProduct(clique, factor);
+        return;
     }
     
-    return potential;
+    Factor factor(std::vector<int>(1, node.id), std::vector<int>(1, node.num_states));
+    if (node.has_cpt && node.cpt.numRows() == 1 && node.cpt.row_set[0]) {
+        // Use CPT for root node (no parents)
+        factor.values.assign(node.cpt.probs.begin(), node.cpt.probs.end());
+    } else {
+        factor.setValues(node.potential);
+    }
+    factorProduct(clique, factor);
+}
+
+bool hasEdgeFactor(const Edge& edge) {
+    return !edge.potential.empty() && edge.from != edge.to;
+}
+
+void multiplyEdgeFactor(Clique& clique, const Edge& edge) {
+    std::vector<int> scope = {edge.from, edge.to};
+    std::vector<int> cards = {clique.cards[clique.position(edge.from)],
+                              clique.cards[clique.position(edge.to)]};
+    Factor factor(scope, cards);
+    // Flatten 2D potential to 1D
+    factor.values.clear();
+    for (const auto& row : edge.potential) {
+        for (double val : row) {
+            factor.values.push_back(val);
+        }
+    }
+    factorProduct(clique, factor);
 }
 
 // Convert Graphical Model to MRF
 MRF convertToMRF(const GraphicalModel& gm) {
     MRF mrf;
     
-    // Copy nodes
+    // Copy nodes; they are indexed once the adjacency is restored below
+    mrf.nodes.reserve(gm.nodes.size());
     for (const auto& node : gm.nodes) {
-        mrf.addNode(node.id, node.name, node.num_states);
+        mrf.nodes.emplace_back(node.id, node.name, node.num_states);
     }
     
-    // If directed, moralize first
-    GraphicalModel gm_copy = gm;
-    if (gm_copy.type == GraphType::DIRECTED) {
-        moralizeGraph(gm_copy);
+    // Cliques of the moral graph. The fill edges live in an overlay, so the
+    // model (CPTs and potentials included) is never copied.
+    MoralGraphView moral(gm);
+    const CSRAdjacency& adj = moral.adjacency;
+    std::vector<Clique> cliques = findMaximalCliques(adj, gm);
+    
+    // Note clique membership; tables are already sized by the cardinalities
+    std::vector<std::vector<int>> member_of(adj.numVertices());
+    for (size_t c = 0; c < cliques.size(); c++) {
+        for (int node_id : cliques[c].vars) {
+            int v = adj.indexOf(node_id);
+            if (v >= 0) member_of[v].push_back((int)c);
+        }
     }
     
-    // Find maximal cliques
-    std::vector<Clique> cliques = findMaximalCliques(gm_copy);
+    // Only maximal cliques are kept, so every node, edge and CPT factor is
+    // multiplied into the first clique that covers its scope. Factors sharing
+    // a clique accumulate; tables whose size does not match are skipped.
+    for (const auto& node : gm.nodes) {
+        int c = findContainingClique(nodeFactorScope(node, gm), cliques, member_of, adj);
+        if (c >= 0) {
+            multiplyNodeFactor(cliques[c], node, gm);
+        }
+    }
     
-    // Add cliques to MRF
-    for (const auto& clique : cliques) {
-        mrf.addClique(clique.nodes);
-        
-        // Check if any node in clique has CPT (for Bayesian Networks)
-        bool has_cpt = false;
-        for (int node_id : clique.nodes) {
-            const Node* node = gm.getNode(node_id);
-            if (node && node->has_cpt) {
-                has_cpt = true;
-                break;
-            }
+    // Fill edges carry no potential, so the model's own edges are all of them
+    for (const auto& edge : gm.edges) {
+        if (!hasEdgeFactor(edge)) continue;
+        int c = findContainingClique({edge.from, edge.to}, cliques, member_of, adj);
+        if (c >= 0) {
+            multiplyEdgeFactor(cliques[c], edge);
         }
-        
-        if (has_cpt && gm.type == GraphType::DIRECTED) {
-            // Convert CPT to potential
-            std::vector<double> potential = convertCPTToPotential(clique.nodes, gm);
-            mrf.cliques.back().setPotential(potential);
-        } else {
-            // Use standard potential assignment
-            if (clique.nodes.size() == 1) {
-                // Single node clique - use node potential or CPT if available
-                const Node* node = gm.getNode(clique.nodes[0]);
-                if (node) {
-                    if (node->has_cpt && !node->cpt.empty()) {
-                        // Use CPT for root node (no parents)
-                        auto cpt_it = node->cpt.find(std::vector<int>());
-                        if (cpt_it != node->cpt.end()) {
-                            mrf.cliques.back().setPotential(cpt_it->second);
-                        } else {
-                            mrf.cliques.back().setPotential(node->potential);
-                        }
-                    } else {
-                        mrf.cliques.back().setPotential(node->potential);
-                    }
-                }
-            } else if (clique.nodes.size() == 2) {
-                // Edge clique - use edge potential
-                Edge* edge = gm_copy.getEdge(clique.nodes[0], clique.nodes[1]);
-                if (edge && !edge->potential.empty()) {
-                    // Flatten 2D potential to 1D
-                    std::vector<double> flat_pot;
-                    for (const auto& row : edge->potential) {
-                        for (double val : row) {
-                            flat_pot.push_back(val);
-                        }
-                    }
-                    mrf.cliques.back().setPotential(flat_pot);
+    }
+    
+    // Add cliques to MRF. Cliques were sized with the same cardinalities
+    // addClique would use, so they move in as they are, and the adjacency
+    // (every clique fully connected) goes straight to its frozen form.
+    CSRAdjacency clique_adj = linkAdjacency(mrf.nodes, [&](const std::function<void(int, int)>& link) {
+        for (const auto& clique : cliques) {
+            const std::vector<int>& vars = clique.vars;
+            for (size_t i = 0; i < vars.size(); i++) {
+                for (size_t j = i + 1; j < vars.size(); j++) {
+                    link(vars[i], vars[j]);
                 }
             }
         }
-    }
-    
+    });
+    mrf.cliques = std::move(cliques);
+    mrf.restoreFrozen(std::move(clique_adj));
     return mrf;
 }
@@ -2,19 +2,18 @@
 #define MRF_H
 
 #include "graph.h"
+#include "factor.h"
 #include <vector>
 #include <map>
 #include <set>
+#include <utility>
 
-// Clique in MRF
-class Clique {
+// Clique in MRF: a factor over the clique's nodes (vars), whose values are
+// the potential function
+class Clique : public Factor {
 public:
-    std::vector<int> nodes;
-    std::vector<double> potential;  // Potential function values
-    
-    Clique(const std::vector<int>& nodes);
+    Clique(const std::vector<int>& nodes, const std::vector<int>& cards);
     void setPotential(const std::vector<double>& pot);
-    int getPotentialIndex(const std::vector<int>& states) const;
 };
 
 // Markov Random Field representation
@@ -22,22 +21,112 @@ class MRF {
 public:
     std::vector<Node> nodes;
     std::vector<Clique> cliques;
-    std::map<int, std::set<int>> adjacency_list;
+    // Mutable adjacency, released in favour of csr while frozen
+    AdjacencyMap adjacency_list;
+    CSRAdjacency csr;
     
     MRF();
     
     void addNode(int id, const std::string& name, int num_states = 2);
+    // Table sized by the cardinalities of the (already added) nodes
     void addClique(const std::vector<int>& nodes);
     void setCliquePotential(int clique_idx, const std::vector<double>& potential);
     
+    Node* getNode(int id);
+    const Node* getNode(int id) const;
+    
+    // Switch adjacency to the compact CSR form once all cliques are added
+    void freezeAdjacency();
+    // Index nodes that were filled in directly and take a prebuilt
+    // adjacency as the frozen form
+    void restoreFrozen(CSRAdjacency&& adjacency);
+    bool isFrozen() const { return frozen; }
+    // CSR view of the current adjacency, building a temporary one if needed
+    CSRAdjacency buildAdjacency() const;
+    
     void print() const;
     int getTotalStates() const;
+
+private:
+    IdIndex node_index;  // Node id -> position in nodes
+    bool frozen;
+    
+    void thawAdjacency();
+};
+
+// Elimination-order heuristics for triangulation
+enum class EliminationHeuristic {
+    MIN_FILL,   // Eliminate the vertex adding the fewest fill edges
+    MIN_DEGREE  // Eliminate the vertex with the fewest remaining neighbors
+};
+
+// Outcome of triangulating a model
+class TriangulationResult {
+public:
+    std::vector<int> elimination_order;      // Node ids, first eliminated first
+    std::vector<std::vector<int>> cliques;   // Maximal elimination cliques (sorted ids)
+    size_t fill_edges;
+    int treewidth;                           // Largest clique size - 1
+    double total_table_size;                 // Sum over cliques of the product of cardinalities
+    
+    TriangulationResult();
+    void print() const;
+};
+
+// Moralization of a directed model kept as an overlay: only the links
+// between co-parents that are not already adjacent, each unordered pair once
+// in discovery order. Empty for undirected models.
+class MoralOverlay {
+public:
+    std::vector<std::pair<int, int>> fill_edges;  // Node ids
+    
+    MoralOverlay();
+    // linked is the undirected adjacency of gm's own edges
+    MoralOverlay(const GraphicalModel& gm, const CSRAdjacency& linked);
 };
 
+// Moral graph of a model that is read but never copied or changed: the
+// model's edges plus its overlay's fill edges, as an undirected CSR laid out
+// like the model's own (nodes first, in order)
+class MoralGraphView {
+public:
+    const GraphicalModel& model;
+    MoralOverlay overlay;
+    CSRAdjacency adjacency;
+    
+    explicit MoralGraphView(const GraphicalModel& gm);
+};
+
+// Largest clique table convertToMRF builds (128 MB of doubles)
+static const double MAX_CLIQUE_TABLE_ENTRIES = 1 << 24;
+
 // Conversion functions
 MRF convertToMRF(const GraphicalModel& gm);
+// Moralize in place: add the overlay's fill edges and make the model undirected
 void moralizeGraph(GraphicalModel& gm);
+// Make gm chordal by adding fill edges (moralizing directed models first)
 void triangulateGraph(GraphicalModel& gm);
+TriangulationResult triangulateGraph(GraphicalModel& gm, EliminationHeuristic heuristic);
 std::vector<Clique> findMaximalCliques(const GraphicalModel& gm);
+// Maximal cliques of an undirected adjacency, with cardinalities from gm.
+// A clique of three or more nodes whose table would exceed
+// MAX_CLIQUE_TABLE_ENTRIES is replaced by its pairs (with a warning), so the
+// result may hold a few non-maximal cliques.
+std::vector<Clique> findMaximalCliques(const CSRAdjacency& adj, const GraphicalModel& gm);
+// False for a clique findMaximalCliques would split
+bool cliqueTableFits(const std::vector<int>& vars, const GraphicalModel& gm);
+// Maximal cliques (sorted node ids, sorted lexicographically) that contain
+// at least one of the given vertices (local indices of adj, undirected)
+std::vector<std::vector<int>> findMaximalCliquesContaining(const CSRAdjacency& adj,
+                                                           const std::vector<int>& vertices);
+
+// Factors of convertToMRF. Each node contributes one factor over
+// nodeFactorScope (its CPT for directed models, else its potential), each
+// edge with a potential one pairwise factor; both are multiplied into the
+// first clique that covers their scope.
+std::vector<int> nodeFactorScope(const Node& node, const GraphicalModel& gm);
+void multiplyNodeFactor(Clique& clique, const Node& node, const GraphicalModel& gm);
+bool hasEdgeFactor(const Edge& edge);
+void multiplyEdgeFactor(Clique& clique, const Edge& edge);
 
 #endif // MRF_H
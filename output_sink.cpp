@@ -0,0 +1,195 @@
+#include "output_sink.h"
+#include <cmath>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+
+OutputSink::OutputSink(int fd, size_t capacity)
+    : buffer(capacity > 64 ? capacity : 64), used(0), fd(fd), text(nullptr), write_failed(false) {
+}
+
+OutputSink::OutputSink(std::string& text, size_t capacity)
+    : buffer(capacity > 64 ? capacity : 64), used(0), fd(-1), text(&text), write_failed(false) {
+}
+
+OutputSink::~OutputSink() {
+    flush();
+}
+
+void OutputSink::pass(const char* data, size_t size) {
+    if (text) {
+        text->append(data, size);
+        return;
+    }
+    while (size > 0 && !write_failed) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            write_failed = true;
+            break;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+}
+
+bool OutputSink::flush() {
+    pass(buffer.data(), used);
+    used = 0;
+    return !write_failed;
+}
+
+char* OutputSink::reserve(size_t n) {
+    if (used + n > buffer.size()) {
+        flush();
+    }
+    return buffer.data() + used;
+}
+
+OutputSink& OutputSink::append(const char* data, size_t size) {
+    if (size > buffer.size()) {
+        // Too big to buffer: pass it on directly
+        flush();
+        pass(data, size);
+        return *this;
+    }
+    std::memcpy(reserve(size), data, size);
+    used += size;
+    return *this;
+}
+
+OutputSink& OutputSink::operator<<(char c) {
+    *reserve(1) = c;
+    used++;
+    return *this;
+}
+
+OutputSink& OutputSink::writeUnsigned(unsigned long long value) {
+    char digits[20];
+    size_t n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    char* out = reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        out[i] = digits[n - 1 - i];
+    }
+    used += n;
+    return *this;
+}
+
+OutputSink& OutputSink::writeInteger(long long value) {
+    if (value < 0) {
+        *this << '-';
+        // Negate in unsigned arithmetic so the minimum value survives
+        return writeUnsigned(0ULL - (unsigned long long)value);
+    }
+    return writeUnsigned((unsigned long long)value);
+}
+
+OutputSink& OutputSink::operator<<(double value) {
+    char* out = reserve(32);
+    used += formatDouble(value, out);
+    return *this;
+}
+
+// Exact powers of ten (every one up to 1e22 is a double)
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// |value| * 10^(5 - exponent): one correctly rounded operation, so within
+// half an ulp of the exact six-digit scaling
+static double scaleToSixDigits(double magnitude, int exponent) {
+    int k = 5 - exponent;
+    return k >= 0 ? magnitude * POW10[k] : magnitude / POW10[-k];
+}
+
+// Six significant digits and decimal exponent of magnitude, rounded as
+// printf would. False where one scaling step cannot settle it: magnitudes
+// whose powers of ten are not exact, and values within rounding error of a
+// tie between two digit strings.
+static bool sixDigits(double magnitude, long& digits, int& exponent) {
+    exponent = (int)std::floor(std::log10(magnitude));
+    if (exponent < -16 || exponent > 21) {
+        return false;
+    }
+    double scaled = scaleToSixDigits(magnitude, exponent);
+    // log10 can be off by one next to powers of ten
+    if (scaled < 100000.0 && exponent > -16) {
+        exponent--;
+        scaled = scaleToSixDigits(magnitude, exponent);
+    } else if (scaled >= 1000000.0 && exponent < 21) {
+        exponent++;
+        scaled = scaleToSixDigits(magnitude, exponent);
+    }
+    double whole = std::floor(scaled);
+    if (scaled < 100000.0 || scaled >= 1000000.0 || std::fabs(scaled - whole - 0.5) < 1e-9) {
+        return false;
+    }
+    digits = (long)whole + (scaled - whole > 0.5 ? 1 : 0);
+    if (digits == 1000000) {
+        // 999999.5 and up round to the next power of ten
+        digits = 100000;
+        exponent++;
+    }
+    return true;
+}
+
+size_t formatDouble(double value, char* out) {
+    long digits = 0;
+    int exponent = 0;
+    double magnitude = std::fabs(value);
+    if (!std::isfinite(value) || (magnitude != 0.0 && !sixDigits(magnitude, digits, exponent))) {
+        return (size_t)std::snprintf(out, 32, "%.6g", value);
+    }
+
+    char* p = out;
+    if (std::signbit(value)) {
+        *p++ = '-';
+    }
+    if (magnitude == 0.0) {
+        *p++ = '0';
+        return p - out;
+    }
+
+    char d[6];
+    for (int i = 5; i >= 0; i--) {
+        d[i] = (char)('0' + digits % 10);
+        digits /= 10;
+    }
+    int last = 5;  // Trailing zeros are dropped, as %g does
+    while (last > 0 && d[last] == '0') {
+        last--;
+    }
+
+    if (exponent < -4 || exponent >= 6) {
+        *p++ = d[0];
+        if (last > 0) {
+            *p++ = '.';
+            for (int i = 1; i <= last; i++) *p++ = d[i];
+        }
+        *p++ = 'e';
+        *p++ = exponent < 0 ? '-' : '+';
+        int e = exponent < 0 ? -exponent : exponent;
+        if (e >= 100) *p++ = (char)('0' + e / 100);
+        *p++ = (char)('0' + e / 10 % 10);
+        *p++ = (char)('0' + e % 10);
+    } else if (exponent >= 0) {
+        for (int i = 0; i <= exponent; i++) *p++ = d[i];
+        if (last > exponent) {
+            *p++ = '.';
+            for (int i = exponent + 1; i <= last; i++) *p++ = d[i];
+        }
+    } else {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > exponent; i--) *p++ = '0';
+        for (int i = 0; i <= last; i++) *p++ = d[i];
+    }
+    return p - out;
+}
@@ -0,0 +1,61 @@
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+
+// Append-only text output for exporters. Pieces are formatted straight into
+// a large buffer that is handed to a file descriptor (or appended to a
+// string) whenever it fills, so memory stays bounded however long the
+// output is. Numbers are formatted without iostreams or locales, with the
+// same text std::ostream's defaults produce (doubles as "%.6g").
+class OutputSink {
+public:
+    static const size_t DEFAULT_CAPACITY = 1 << 20;
+
+    // Write to an open descriptor; the sink does not close it
+    explicit OutputSink(int fd, size_t capacity = DEFAULT_CAPACITY);
+    // Append to text
+    explicit OutputSink(std::string& text, size_t capacity = DEFAULT_CAPACITY);
+    ~OutputSink();  // Flushes
+
+    OutputSink& operator<<(const char* text) { return append(text, std::strlen(text)); }
+    OutputSink& operator<<(const std::string& text) { return append(text.data(), text.size()); }
+    OutputSink& operator<<(char c);
+    OutputSink& operator<<(int value) { return writeInteger(value); }
+    OutputSink& operator<<(long value) { return writeInteger(value); }
+    OutputSink& operator<<(long long value) { return writeInteger(value); }
+    OutputSink& operator<<(unsigned int value) { return writeUnsigned(value); }
+    OutputSink& operator<<(unsigned long value) { return writeUnsigned(value); }
+    OutputSink& operator<<(unsigned long long value) { return writeUnsigned(value); }
+    OutputSink& operator<<(double value);
+
+    OutputSink& append(const char* data, size_t size);
+    // Hand the buffered text on; false once any write has failed
+    bool flush();
+    bool failed() const { return write_failed; }
+
+private:
+    std::vector<char> buffer;
+    size_t used;
+    int fd;                // -1 when writing to text
+    std::string* text;
+    bool write_failed;
+
+    // Room for n more bytes, flushing first if needed
+    char* reserve(size_t n);
+    void pass(const char* data, size_t size);  // Straight to the destination
+    OutputSink& writeInteger(long long value);
+    OutputSink& writeUnsigned(unsigned long long value);
+
+    OutputSink(const OutputSink&);
+    OutputSink& operator=(const OutputSink&);
+};
+
+// Text of value as printf("%.6g") (and so std::ostream by default) would
+// write it. out needs room for 32 characters; returns the length.
+size_t formatDouble(double value, char* out);
+
+#endif // OUTPUT_SINK_H
@@ -1,9 +1,11 @@
 #include "qpu_circuit.h"
 #include "mrf.h"
+#include "circuit_dag.h"
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <cmath>
+#include <algorithm>
 
 // QuantumGate implementation
 QuantumGate::QuantumGate(GateType t, int target, int control, double param)
@@ -43,6 +45,9 @@ std::string QuantumGate::toString() const {
         case GateType::MEASURE:
             oss << "MEASURE(" << target_qubit << ")";
             break;
+        case GateType::RZZ:
+            oss << "RZZ(" << control_qubit << ", " << target_qubit << ", " << parameter << ")";
+            break;
     }
     return oss.str();
 }
@@ -60,6 +65,10 @@ void QPUCircuit::addMeasurement(int qubit) {
     measurement_qubits.push_back(qubit);
 }
 
+size_t QPUCircuit::depth() const {
+    return CircuitDAG(*this).depth();
+}
+
 void QPUCircuit::print() const {
     std::cout << "QPU Circuit (" << num_qubits << " qubits)\n";
     std::cout << "Gates:\n";
@@ -107,6 +116,10 @@ void QPUCircuit::printQASM() const {
             case GateType::MEASURE:
                 std::cout << "measure q[" << gate.target_qubit << "] -> c[" << gate.target_qubit << "];\n";
                 break;
+            case GateType::RZZ:
+                std::cout << "rzz(" << gate.parameter << ") q[" << gate.control_qubit
+                          << "],q[" << gate.target_qubit << "];\n";
+                break;
         }
     }
 }
@@ -117,41 +130,94 @@ void QPUCircuit::printOpenQASM() const {
 
 // Encode clique potential into quantum circuit
 void encodeCliquePotential(const Clique& clique, QPUCircuit& circuit, 
-                          const std::map<int, int>& qubit_map) {
-    if (clique.nodes.size() == 1) {
+                          const CSRAdjacency& adjacency) {
+    size_t k = clique.vars.size();
+    for (int card : clique.cards) {
+        if (card != 2) {
+            return;  // Only binary cliques have an Ising encoding
+        }
+    }
+    if (k == 0 || clique.values.size() != clique.tableSize()) {
+        return;
+    }
+    if (k == 1) {
         // Single qubit potential - use rotation gates
-        int qubit = qubit_map.at(clique.nodes[0]);
+        int qubit = adjacency.indexOf(clique.vars[0]);
         // Encode potential as rotation
-        double angle = std::log(clique.potential[1] / clique.potential[0]);
+        double angle = std::log(clique.values[1] / clique.values[0]);
         circuit.addGate(GateType::RY, qubit, -1, angle);
-    } else if (clique.nodes.size() == 2) {
-        // Two-qubit potential - use CNOT and rotations
-        int q1 = qubit_map.at(clique.nodes[0]);
-        int q2 = qubit_map.at(clique.nodes[1]);
-        
-        // Encode Ising interaction
-        // For binary states, we can encode as: exp(-J * Z_i * Z_j)
-        double J = std::log(clique.potential[3] * clique.potential[0] / 
-                           (clique.potential[1] * clique.potential[2])) / 4.0;
-        
-        if (std::abs(J) > 1e-10) {
-            // Apply CNOT
-            circuit.addGate(GateType::CNOT, q2, q1);
-            // Apply RZ rotation
-            circuit.addGate(GateType::RZ, q2, -1, 2.0 * J);
-            // Apply CNOT again
-            circuit.addGate(GateType::CNOT, q2, q1);
+        return;
+    }
+    
+    // Project the log-potential onto Ising terms over spins z = 1 - 2s:
+    //   h_i = 2^-k sum_s f(s) z_i,  J_ij = 2^-k sum_s f(s) z_i z_j
+    // These are Walsh coefficients of f, so one in-place Walsh-Hadamard
+    // transform gives all of them in size * k steps. The last variable
+    // varies fastest, so variable i is bit k - 1 - i of the table index.
+    // Higher-order terms of larger cliques are dropped.
+    size_t size = clique.values.size();
+    std::vector<double> walsh(size);
+    for (size_t s = 0; s < size; s++) {
+        walsh[s] = std::log(std::max(clique.values[s], 1e-300));
+    }
+    for (size_t half = 1; half < size; half <<= 1) {
+        for (size_t base = 0; base < size; base += 2 * half) {
+            for (size_t s = base; s < base + half; s++) {
+                double a = walsh[s];
+                double b = walsh[s + half];
+                walsh[s] = a + b;
+                walsh[s + half] = a - b;
+            }
+        }
+    }
+    std::vector<size_t> bit(k);
+    for (size_t i = 0; i < k; i++) {
+        bit[i] = (size_t)1 << (k - 1 - i);
+    }
+    std::vector<double> h(k, 0.0);
+    std::vector<double> J(k * k, 0.0);
+    for (size_t i = 0; i < k; i++) {
+        h[i] = walsh[bit[i]];
+        for (size_t j = i + 1; j < k; j++) {
+            J[i * k + j] = walsh[bit[i] | bit[j]];
+        }
+    }
+    
+    std::vector<int> qubits(k);
+    for (size_t i = 0; i < k; i++) {
+        qubits[i] = adjacency.indexOf(clique.vars[i]);
+        // Local field, same convention as the single-node case
+        double angle = -2.0 * h[i] / size;
+        if (std::abs(angle) > 1e-10) {
+            circuit.addGate(GateType::RY, qubits[i], -1, angle);
+        }
+    }
+    
+    for (size_t i = 0; i < k; i++) {
+        for (size_t j = i + 1; j < k; j++) {
+            // Encode Ising interaction
+            // For binary states, we can encode as: exp(-J * Z_i * Z_j)
+            double coupling = J[i * k + j] / size;
+            if (std::abs(coupling) > 1e-10) {
+                // Apply CNOT
+                circuit.addGate(GateType::CNOT, qubits[j], qubits[i]);
+                // Apply RZ rotation
+                circuit.addGate(GateType::RZ, qubits[j], -1, 2.0 * coupling);
+                // Apply CNOT again
+                circuit.addGate(GateType::CNOT, qubits[j], qubits[i]);
+            }
         }
     }
 }
 
 // Apply Ising Hamiltonian representation
 void applyIsingHamiltonian(const MRF& mrf, QPUCircuit& circuit) {
-    // Create qubit mapping
-    std::map<int, int> qubit_map;
-    for (size_t i = 0; i < mrf.nodes.size(); i++) {
-        qubit_map[mrf.nodes[i].id] = i;
+    // Qubit i is mrf.nodes[i], which is also its local CSR index
+    CSRAdjacency local;
+    if (!mrf.isFrozen()) {
+        local = mrf.buildAdjacency();
     }
+    const CSRAdjacency& adjacency = mrf.isFrozen() ? mrf.csr : local;
     
     // Initialize all qubits in superposition
     for (size_t i = 0; i < mrf.nodes.size(); i++) {
@@ -159,9 +225,12 @@ void applyIsingHamiltonian(const MRF& mrf, QPUCircuit& circuit) {
     }
     
     // Encode each clique
+    circuit.clique_gate_offsets.clear();
     for (const auto& clique : mrf.cliques) {
-        encodeCliquePotential(clique, circuit, qubit_map);
+        circuit.clique_gate_offsets.push_back(circuit.gates.size());
+        encodeCliquePotential(clique, circuit, adjacency);
     }
+    circuit.clique_gate_offsets.push_back(circuit.gates.size());
     
     // Add measurements
     for (size_t i = 0; i < mrf.nodes.size(); i++) {
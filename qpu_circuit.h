@@ -17,7 +17,8 @@ enum class GateType {
     RY,     // Rotation around Y-axis
     RX,     // Rotation around X-axis
     CPHASE, // Controlled phase
-    MEASURE // Measurement
+    MEASURE, // Measurement
+    RZZ     // ZZ rotation exp(-i theta/2 Z Z); only produced by optimizeCircuit
 };
 
 // Quantum gate
@@ -32,17 +33,26 @@ public:
     std::string toString() const;
 };
 
+// Gates are many and small; built inside an ArenaScope they come from the
+// compilation's arena
+typedef std::vector<QuantumGate, ArenaAllocator<QuantumGate>> GateList;
+
 // QPU Circuit representation
 class QPUCircuit {
 public:
     int num_qubits;
-    std::vector<QuantumGate> gates;
+    GateList gates;
     std::vector<int> measurement_qubits;
+    // Start of each clique's encoding in gates, plus the end of the last one.
+    // Set by applyIsingHamiltonian; passes that reorder gates must clear it.
+    std::vector<size_t> clique_gate_offsets;
     
     QPUCircuit(int num_qubits);
     
     void addGate(GateType type, int target, int control = -1, double param = 0.0);
     void addMeasurement(int qubit);
+    // Layers of gates when each gate starts as soon as its qubits are free
+    size_t depth() const;
     void print() const;
     void printQASM() const;  // Print in QASM format
     void printOpenQASM() const;  // Print in OpenQASM 2.0 format
@@ -50,8 +60,9 @@ public:
 
 // Conversion functions
 QPUCircuit convertMRFToQPU(const MRF& mrf);
+// Qubits are numbered by the MRF's local vertex index in its CSR adjacency
 void encodeCliquePotential(const Clique& clique, QPUCircuit& circuit, 
-                          const std::map<int, int>& qubit_map);
+                          const CSRAdjacency& adjacency);
 void applyIsingHamiltonian(const MRF& mrf, QPUCircuit& circuit);
 
 #endif // QPU_CIRCUIT_H
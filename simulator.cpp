@@ -0,0 +1,565 @@
+#include "simulator.h"
+#include "factor_ops.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SIMULATOR_X86 1
+#include <immintrin.h>
+#endif
+
+// k with a zero bit inserted at position bit
+static inline uint64_t insertZero(uint64_t k, int bit) {
+    uint64_t low = k & ((uint64_t(1) << bit) - 1);
+    return ((k ^ low) << 1) | low;
+}
+
+// Index of the k-th amplitude pair a gate acts on: target (and control) bits
+// cleared, the other bits counting up with k. The caller sets the control bit.
+static inline uint64_t pairIndex(uint64_t k, int target, int control) {
+    if (control < 0) {
+        return insertZero(k, target);
+    }
+    return insertZero(insertZero(k, std::min(target, control)), std::max(target, control));
+}
+
+// Written out: std::complex's operator* checks for inf/nan on every product
+static inline Amplitude mul(const Amplitude& x, const Amplitude& y) {
+    return Amplitude(x.real() * y.real() - x.imag() * y.imag(),
+                     x.real() * y.imag() + x.imag() * y.real());
+}
+
+// Kernels apply m to pairs [begin, end) of the amplitudes at a
+typedef void (*ApplyKernel)(Amplitude* a, uint64_t begin, uint64_t end, int target, int control,
+                            const Amplitude m[4]);
+
+// Scalar kernel
+static void scalarApply(Amplitude* a, uint64_t begin, uint64_t end, int target, int control,
+                        const Amplitude m[4]) {
+    uint64_t t = uint64_t(1) << target;
+    uint64_t c = control >= 0 ? uint64_t(1) << control : 0;
+    if (m[1] == 0.0 && m[2] == 0.0) {
+        bool keep0 = m[0] == 1.0;  // Phase gates only touch the 1 half
+        for (uint64_t k = begin; k < end; k++) {
+            uint64_t i = pairIndex(k, target, control) | c;
+            if (!keep0) a[i] = mul(m[0], a[i]);
+            a[i | t] = mul(m[3], a[i | t]);
+        }
+        return;
+    }
+    for (uint64_t k = begin; k < end; k++) {
+        uint64_t i = pairIndex(k, target, control) | c;
+        Amplitude a0 = a[i];
+        Amplitude a1 = a[i | t];
+        a[i] = mul(m[0], a0) + mul(m[1], a1);
+        a[i | t] = mul(m[2], a0) + mul(m[3], a1);
+    }
+}
+
+#ifdef SIMULATOR_X86
+
+// Two interleaved complex numbers v times (re + i im), re and im holding
+// each factor's parts twice
+__attribute__((target("avx2,fma")))
+static inline __m256d cmul256(__m256d v, __m256d re, __m256d im) {
+    return _mm256_fmaddsub_pd(v, re, _mm256_mul_pd(_mm256_permute_pd(v, 0x5), im));
+}
+
+// AVX2 kernel. Where target and control are both above qubit 0, pairs come
+// in runs of neighbouring amplitudes, handled two pairs per step. A target of
+// qubit 0 has both halves of a pair in one register.
+__attribute__((target("avx2,fma")))
+static void avx2Apply(Amplitude* a, uint64_t begin, uint64_t end, int target, int control,
+                      const Amplitude m[4]) {
+    uint64_t t = uint64_t(1) << target;
+    uint64_t c = control >= 0 ? uint64_t(1) << control : 0;
+    double* d = reinterpret_cast<double*>(a);
+    if (target > 0 && control != 0 && begin % 2 == 0 && end % 2 == 0) {
+        // Runs of 2^(lowest of target and control) pairs; k runs through
+        // them piecewise, as [begin, end) need not cover whole runs
+        uint64_t run = uint64_t(1) << (control < 0 ? target : std::min(target, control));
+        __m256d re[4];
+        __m256d im[4];
+        for (int e = 0; e < 4; e++) {
+            re[e] = _mm256_set1_pd(m[e].real());
+            im[e] = _mm256_set1_pd(m[e].imag());
+        }
+        bool diagonal = m[1] == 0.0 && m[2] == 0.0;
+        bool keep0 = diagonal && m[0] == 1.0;
+        for (uint64_t k = begin; k < end;) {
+            uint64_t length = std::min(run - (k & (run - 1)), end - k);
+            double* p0 = d + 2 * (pairIndex(k, target, control) | c);
+            double* p1 = p0 + 2 * t;
+            if (diagonal) {
+                for (uint64_t j = 0; j < 2 * length; j += 4) {
+                    if (!keep0) {
+                        _mm256_store_pd(p0 + j, cmul256(_mm256_load_pd(p0 + j), re[0], im[0]));
+                    }
+                    _mm256_store_pd(p1 + j, cmul256(_mm256_load_pd(p1 + j), re[3], im[3]));
+                }
+            } else {
+                for (uint64_t j = 0; j < 2 * length; j += 4) {
+                    __m256d a0 = _mm256_load_pd(p0 + j);
+                    __m256d a1 = _mm256_load_pd(p1 + j);
+                    _mm256_store_pd(p0 + j, _mm256_add_pd(cmul256(a0, re[0], im[0]), cmul256(a1, re[1], im[1])));
+                    _mm256_store_pd(p1 + j, _mm256_add_pd(cmul256(a0, re[2], im[2]), cmul256(a1, re[3], im[3])));
+                }
+            }
+            k += length;
+        }
+        return;
+    }
+    if (target == 0 && control < 0) {
+        // Register [a0, a1] becomes [m0 a0 + m1 a1, m2 a0 + m3 a1]
+        __m256d re0 = _mm256_setr_pd(m[0].real(), m[0].real(), m[2].real(), m[2].real());
+        __m256d im0 = _mm256_setr_pd(m[0].imag(), m[0].imag(), m[2].imag(), m[2].imag());
+        __m256d re1 = _mm256_setr_pd(m[1].real(), m[1].real(), m[3].real(), m[3].real());
+        __m256d im1 = _mm256_setr_pd(m[1].imag(), m[1].imag(), m[3].imag(), m[3].imag());
+        for (uint64_t k = begin; k < end; k++) {
+            __m256d v = _mm256_load_pd(d + 4 * k);
+            __m256d lo = _mm256_permute2f128_pd(v, v, 0x00);
+            __m256d hi = _mm256_permute2f128_pd(v, v, 0x11);
+            _mm256_store_pd(d + 4 * k, _mm256_add_pd(cmul256(lo, re0, im0), cmul256(hi, re1, im1)));
+        }
+        return;
+    }
+    // Controlled gates touching qubit 0 leave no contiguous runs
+    scalarApply(a, begin, end, target, control, m);
+}
+
+#endif
+
+static ApplyKernel activeKernel() {
+#ifdef SIMULATOR_X86
+    if (activeSimdLevel() != SimdLevel::SCALAR) {
+        return avx2Apply;
+    }
+#endif
+    return scalarApply;
+}
+
+// Pairs per task when one op is spread over the whole state
+static const uint64_t CHUNK_PAIRS = uint64_t(1) << 13;
+
+// op on the 2^block_qubits amplitudes at block, which start at index base
+// of the full state
+static void applyInBlock(ApplyKernel kernel, Amplitude* block, uint64_t base, int block_qubits,
+                         const SimulationOp& op) {
+    int control = op.control;
+    if (control >= block_qubits) {
+        if (!(base >> control & 1)) {
+            return;
+        }
+        control = -1;
+    }
+    uint64_t size = uint64_t(1) << block_qubits;
+    if (op.target < block_qubits) {
+        kernel(block, 0, size >> (control >= 0 ? 2 : 1), op.target, control, op.m);
+        return;
+    }
+    // Diagonal on a qubit above the block: a single phase for the block, or
+    // for its half where the control is 1
+    Amplitude phase = (base >> op.target & 1) ? op.m[3] : op.m[0];
+    if (phase == 1.0) {
+        return;
+    }
+    Amplitude d[4] = {control >= 0 ? Amplitude(1.0) : phase, 0.0, 0.0, phase};
+    kernel(block, 0, size >> 1, control >= 0 ? control : 0, -1, d);
+}
+
+// Ops of a gate: none for MEASURE, two for RZZ, otherwise one
+static size_t gateOps(const QuantumGate& gate, SimulationOp ops[2]) {
+    const Amplitude I(0.0, 1.0);
+    SimulationOp& op = ops[0];
+    double c = std::cos(gate.parameter / 2);
+    double s = std::sin(gate.parameter / 2);
+    Amplitude* m = op.m;
+    op.target = gate.target_qubit;
+    op.control = -1;
+    switch (gate.type) {
+        case GateType::H: {
+            double r = 1.0 / std::sqrt(2.0);
+            m[0] = r; m[1] = r; m[2] = r; m[3] = -r;
+            break;
+        }
+        case GateType::X:
+            m[0] = 0.0; m[1] = 1.0; m[2] = 1.0; m[3] = 0.0;
+            break;
+        case GateType::Y:
+            m[0] = 0.0; m[1] = -I; m[2] = I; m[3] = 0.0;
+            break;
+        case GateType::Z:
+            m[0] = 1.0; m[1] = 0.0; m[2] = 0.0; m[3] = -1.0;
+            break;
+        case GateType::CNOT:
+            m[0] = 0.0; m[1] = 1.0; m[2] = 1.0; m[3] = 0.0;
+            op.control = gate.control_qubit;
+            break;
+        case GateType::RX:
+            m[0] = c; m[1] = -I * s; m[2] = -I * s; m[3] = c;
+            break;
+        case GateType::RY:
+            m[0] = c; m[1] = -s; m[2] = s; m[3] = c;
+            break;
+        case GateType::RZ:
+            m[0] = Amplitude(c, -s); m[1] = 0.0; m[2] = 0.0; m[3] = Amplitude(c, s);
+            break;
+        case GateType::CPHASE:
+            m[0] = 1.0; m[1] = 0.0; m[2] = 0.0;
+            m[3] = Amplitude(std::cos(gate.parameter), std::sin(gate.parameter));
+            op.control = gate.control_qubit;
+            break;
+        case GateType::MEASURE:
+            return 0;
+        case GateType::RZZ:
+            // RZ(theta) on the target, turned into RZ(-theta) where the
+            // control is 1
+            m[0] = Amplitude(c, -s); m[1] = 0.0; m[2] = 0.0; m[3] = Amplitude(c, s);
+            ops[1].target = gate.target_qubit;
+            ops[1].control = gate.control_qubit;
+            ops[1].m[0] = Amplitude(std::cos(gate.parameter), std::sin(gate.parameter));
+            ops[1].m[1] = 0.0;
+            ops[1].m[2] = 0.0;
+            ops[1].m[3] = std::conj(ops[1].m[0]);
+            return 2;
+    }
+    return 1;
+}
+
+SimulationOp::SimulationOp() : target(0), control(-1) {
+    m[0] = 1.0; m[1] = 0.0; m[2] = 0.0; m[3] = 1.0;
+}
+
+PlanSegment::PlanSegment(size_t begin, size_t end, bool blocked) : begin(begin), end(end), blocked(blocked) {
+}
+
+SimulationPlan::SimulationPlan() : num_qubits(0), block_qubits(0), gates(0) {
+}
+
+size_t SimulationPlan::blockedOps() const {
+    size_t count = 0;
+    for (const PlanSegment& segment : segments) {
+        if (segment.blocked) {
+            count += segment.end - segment.begin;
+        }
+    }
+    return count;
+}
+
+void SimulationPlan::print() const {
+    size_t blocked_segments = 0;
+    for (const PlanSegment& segment : segments) {
+        blocked_segments += segment.blocked ? 1 : 0;
+    }
+    std::cout << "Simulation plan: " << gates << " gates fused into " << ops.size() << " passes, "
+              << blockedOps() << " of them in " << blocked_segments << " runs over blocks of 2^"
+              << block_qubits << " amplitudes\n";
+}
+
+SimulationPlan planSimulation(const QPUCircuit& circuit, int block_qubits) {
+    SimulationPlan plan;
+    plan.num_qubits = circuit.num_qubits;
+    plan.block_qubits = std::max(0, std::min(block_qubits, circuit.num_qubits));
+
+    // Single-qubit gates waiting on their qubit, as one product matrix
+    std::vector<SimulationOp> pending(circuit.num_qubits > 0 ? circuit.num_qubits : 0);
+    std::vector<char> have_pending(pending.size(), 0);
+    auto emit = [&](int q) {
+        if (have_pending[q]) {
+            const Amplitude* m = pending[q].m;
+            if (!(m[0] == 1.0 && m[1] == 0.0 && m[2] == 0.0 && m[3] == 1.0)) {
+                plan.ops.push_back(pending[q]);
+            }
+            have_pending[q] = 0;
+        }
+    };
+    for (const QuantumGate& gate : circuit.gates) {
+        SimulationOp ops[2];
+        size_t count = gateOps(gate, ops);
+        if (count == 0) {
+            continue;
+        }
+        plan.gates++;
+        const SimulationOp& op = ops[0];
+        if (count > 1 || op.control >= 0) {
+            emit(gate.target_qubit);
+            emit(gate.control_qubit);
+            plan.ops.insert(plan.ops.end(), ops, ops + count);
+            continue;
+        }
+        SimulationOp& p = pending[op.target];
+        if (!have_pending[op.target]) {
+            p = op;
+            have_pending[op.target] = 1;
+            continue;
+        }
+        // The later gate multiplies from the left
+        Amplitude m[4] = {
+            mul(op.m[0], p.m[0]) + mul(op.m[1], p.m[2]), mul(op.m[0], p.m[1]) + mul(op.m[1], p.m[3]),
+            mul(op.m[2], p.m[0]) + mul(op.m[3], p.m[2]), mul(op.m[2], p.m[1]) + mul(op.m[3], p.m[3])
+        };
+        std::copy(m, m + 4, p.m);
+    }
+    for (int q = 0; q < circuit.num_qubits; q++) {
+        emit(q);
+    }
+
+    for (size_t k = 0; k < plan.ops.size();) {
+        const SimulationOp& op = plan.ops[k];
+        bool blocked = op.target < plan.block_qubits || op.diagonal();
+        size_t end = k + 1;
+        if (blocked) {
+            while (end < plan.ops.size() &&
+                   (plan.ops[end].target < plan.block_qubits || plan.ops[end].diagonal())) {
+                end++;
+            }
+        }
+        plan.segments.push_back(PlanSegment(k, end, blocked));
+        k = end;
+    }
+    return plan;
+}
+
+StateVector::StateVector() : num_qubits(0), num_threads(0) {
+}
+
+void StateVector::setThreads(size_t num_threads) {
+    if (num_threads != this->num_threads) {
+        pool.reset();
+    }
+    this->num_threads = num_threads;
+}
+
+ThreadPool& StateVector::threads() {
+    if (!pool) {
+        pool.reset(new ThreadPool(num_threads));
+    }
+    return *pool;
+}
+
+bool StateVector::reset(int num_qubits) {
+    if (num_qubits < 0 || num_qubits > MAX_SIMULATED_QUBITS) {
+        std::cerr << "Error: cannot simulate " << num_qubits << " qubits (at most "
+                  << MAX_SIMULATED_QUBITS << ")\n";
+        this->num_qubits = 0;
+        amplitudes.clear();
+        return false;
+    }
+    this->num_qubits = num_qubits;
+    amplitudes.assign(size_t(1) << num_qubits, Amplitude(0.0, 0.0));
+    amplitudes[0] = 1.0;
+    return true;
+}
+
+void StateVector::apply(int target, int control, const Amplitude m[4]) {
+    ApplyKernel kernel = activeKernel();
+    Amplitude* a = amplitudes.data();
+    uint64_t pairs = uint64_t(amplitudes.size()) >> (control >= 0 ? 2 : 1);
+    uint64_t chunks = (pairs + CHUNK_PAIRS - 1) / CHUNK_PAIRS;
+    if (chunks <= 1) {
+        kernel(a, 0, pairs, target, control, m);
+        return;
+    }
+    threads().parallelFor(chunks, [&](size_t k) {
+        kernel(a, k * CHUNK_PAIRS, std::min(pairs, (k + 1) * CHUNK_PAIRS), target, control, m);
+    });
+}
+
+void StateVector::applyGate(const QuantumGate& gate) {
+    SimulationOp ops[2];
+    size_t count = gateOps(gate, ops);
+    for (size_t k = 0; k < count; k++) {
+        apply(ops[k].target, ops[k].control, ops[k].m);
+    }
+}
+
+void StateVector::run(const SimulationPlan& plan) {
+    ApplyKernel kernel = activeKernel();
+    Amplitude* a = amplitudes.data();
+    int block_qubits = plan.block_qubits;
+    size_t blocks = amplitudes.size() >> block_qubits;
+    for (const PlanSegment& segment : plan.segments) {
+        if (!segment.blocked) {
+            for (size_t k = segment.begin; k < segment.end; k++) {
+                apply(plan.ops[k].target, plan.ops[k].control, plan.ops[k].m);
+            }
+            continue;
+        }
+        auto runBlock = [&](size_t b) {
+            uint64_t base = uint64_t(b) << block_qubits;
+            for (size_t k = segment.begin; k < segment.end; k++) {
+                applyInBlock(kernel, a + base, base, block_qubits, plan.ops[k]);
+            }
+        };
+        if (blocks > 1) {
+            threads().parallelFor(blocks, runBlock);
+        } else {
+            runBlock(0);
+        }
+    }
+}
+
+SimulationResult::SimulationResult() : shots(0) {
+}
+
+std::string SimulationResult::bitstring(uint64_t outcome) const {
+    std::string bits(measured.size(), '0');
+    for (size_t m = 0; m < measured.size(); m++) {
+        if (outcome >> m & 1) {
+            bits[m] = '1';
+        }
+    }
+    return bits;
+}
+
+void SimulationResult::print(size_t max_outcomes) const {
+    std::cout << "Sampled " << shots << " shots of " << measured.size() << " qubits (";
+    for (size_t m = 0; m < measured.size(); m++) {
+        std::cout << (m > 0 ? " " : "") << "q" << measured[m];
+    }
+    std::cout << "), " << counts.size() << " distinct outcomes:\n";
+    for (size_t k = 0; k < counts.size() && k < max_outcomes; k++) {
+        std::cout << "  " << bitstring(counts[k].first) << "  " << counts[k].second
+                  << "  (" << (double)counts[k].second / shots << ")\n";
+    }
+    if (counts.size() > max_outcomes) {
+        std::cout << "  ... " << (counts.size() - max_outcomes) << " more\n";
+    }
+}
+
+// Gates must name qubits of the circuit, and nothing may follow a
+// measurement on the qubits it touches
+static bool checkCircuit(const QPUCircuit& circuit, std::vector<int>& measured) {
+    std::vector<char> done(circuit.num_qubits > 0 ? circuit.num_qubits : 0, 0);
+    measured.clear();
+    for (size_t g = 0; g < circuit.gates.size(); g++) {
+        const QuantumGate& gate = circuit.gates[g];
+        bool controlled = gate.type == GateType::CNOT || gate.type == GateType::CPHASE ||
+                          gate.type == GateType::RZZ;
+        int t = gate.target_qubit;
+        int c = controlled ? gate.control_qubit : -1;
+        if (t < 0 || t >= circuit.num_qubits || (controlled && (c < 0 || c >= circuit.num_qubits || c == t))) {
+            std::cerr << "Error: gate " << g << " (" << gate.toString() << ") has invalid qubits\n";
+            return false;
+        }
+        if (gate.type == GateType::MEASURE) {
+            if (!done[t]) {
+                done[t] = 1;
+                measured.push_back(t);
+            }
+        } else if (done[t] || (c >= 0 && done[c])) {
+            std::cerr << "Error: gate " << g << " (" << gate.toString()
+                      << ") acts on a measured qubit; only terminal measurements are simulated\n";
+            return false;
+        }
+    }
+    if (measured.empty()) {
+        for (int q = 0; q < circuit.num_qubits; q++) {
+            measured.push_back(q);
+        }
+    }
+    return true;
+}
+
+bool simulateCircuit(const QPUCircuit& circuit, size_t shots, SimulationResult& result,
+                     size_t num_threads, uint64_t seed) {
+    result = SimulationResult();
+    StateVector state;
+    state.setThreads(num_threads);
+    if (!checkCircuit(circuit, result.measured) || !state.reset(circuit.num_qubits)) {
+        return false;
+    }
+    state.run(planSimulation(circuit));
+
+    // Sorted uniform draws against the running total of probabilities: one
+    // pass over the state serves every shot
+    double total = 0.0;
+    for (uint64_t i = 0; i < state.amplitudes.size(); i++) {
+        total += state.probability(i);
+    }
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, total);
+    std::vector<double> draws(shots);
+    for (double& u : draws) {
+        u = uniform(rng);
+    }
+    std::sort(draws.begin(), draws.end());
+
+    std::vector<uint64_t> outcomes;
+    outcomes.reserve(shots);
+    double running = 0.0;
+    size_t next = 0;
+    uint64_t last = state.amplitudes.size() - 1;
+    for (uint64_t i = 0; i <= last && next < shots; i++) {
+        running += state.probability(i);
+        uint64_t outcome = 0;
+        bool have_outcome = false;
+        // Rounding can leave the last draws above the final running total
+        while (next < shots && (draws[next] < running || i == last)) {
+            if (!have_outcome) {
+                for (size_t m = 0; m < result.measured.size(); m++) {
+                    outcome |= (i >> result.measured[m] & 1) << m;
+                }
+                have_outcome = true;
+            }
+            outcomes.push_back(outcome);
+            next++;
+        }
+    }
+
+    std::sort(outcomes.begin(), outcomes.end());
+    for (size_t k = 0; k < outcomes.size(); k++) {
+        if (k == 0 || outcomes[k] != outcomes[k - 1]) {
+            result.counts.push_back(std::make_pair(outcomes[k], size_t(0)));
+        }
+        result.counts.back().second++;
+    }
+    std::stable_sort(result.counts.begin(), result.counts.end(),
+                     [](const std::pair<uint64_t, size_t>& x, const std::pair<uint64_t, size_t>& y) {
+                         return x.second > y.second;
+                     });
+    result.shots = shots;
+    return true;
+}
+
+bool benchmarkSimulation(const QPUCircuit& circuit, size_t max_threads) {
+    std::vector<int> measured;
+    StateVector state;
+    if (!checkCircuit(circuit, measured) || !state.reset(circuit.num_qubits)) {
+        return false;
+    }
+    SimulationPlan plan = planSimulation(circuit);
+    plan.print();
+
+    if (max_threads == 0) {
+        max_threads = ThreadPool::hardwareThreads();
+    }
+    std::vector<size_t> counts;
+    for (size_t n = 1; n < max_threads; n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(max_threads);
+
+    double updates = (double)plan.gates * (double)state.amplitudes.size();
+    double single = 0.0;
+    std::cout << "threads  seconds  amplitude updates/s  speedup\n";
+    for (size_t n : counts) {
+        state.setThreads(n);
+        state.reset(circuit.num_qubits);
+        auto start = std::chrono::steady_clock::now();
+        state.run(plan);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (n == 1) {
+            single = seconds;
+        }
+        char line[96];
+        std::snprintf(line, sizeof(line), "%7zu  %7.3f  %19.3e  %7.2f\n", n, seconds,
+                      seconds > 0.0 ? updates / seconds : 0.0, seconds > 0.0 ? single / seconds : 0.0);
+        std::cout << line;
+    }
+    return true;
+}
@@ -0,0 +1,131 @@
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "factor.h"
+#include "qpu_circuit.h"
+#include "thread_pool.h"
+#include <vector>
+#include <string>
+#include <complex>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+typedef std::complex<double> Amplitude;
+typedef std::vector<Amplitude, AlignedAllocator<Amplitude, 64>> AmplitudeBuffer;
+
+// 2^30 amplitudes take 16 GB
+static const int MAX_SIMULATED_QUBITS = 30;
+// Cache blocks of 2^14 amplitudes (256 KB) stay in L2 while a run of gates
+// is applied to them
+static const int BLOCK_QUBITS = 14;
+
+// One pass of the simulator: the row-major 2x2 matrix m on target, applied
+// only where control (if >= 0) is 1. A run of single-qubit gates on one
+// qubit is fused into a single op.
+class SimulationOp {
+public:
+    int target;
+    int control;
+    Amplitude m[4];
+
+    SimulationOp();
+    bool diagonal() const { return m[1] == 0.0 && m[2] == 0.0; }
+};
+
+// Consecutive ops [begin, end). A blocked segment is applied one cache block
+// at a time, every op of the segment before moving on to the next block;
+// otherwise each op is one pass over the whole state.
+class PlanSegment {
+public:
+    size_t begin;
+    size_t end;
+    bool blocked;
+
+    PlanSegment(size_t begin, size_t end, bool blocked);
+};
+
+// A circuit's gates (MEASURE excluded) compiled into fused ops, grouped into
+// segments. An op fits in a block if its target is inside the block or it is
+// diagonal; qubits above the block are constant within it, so their controls
+// and phases are settled per block.
+class SimulationPlan {
+public:
+    int num_qubits;
+    int block_qubits;  // Blocks of 2^block_qubits amplitudes
+    size_t gates;      // Gates of the circuit this plan stands for
+    std::vector<SimulationOp> ops;
+    std::vector<PlanSegment> segments;
+
+    SimulationPlan();
+    size_t blockedOps() const;
+    void print() const;
+};
+
+// Plan circuit's gates. Single-qubit gates are multiplied into the pending
+// matrix of their qubit, which is emitted when a two-qubit gate touches that
+// qubit (or at the end); ops are then segmented for blocks of block_qubits
+// qubits (fewer if the circuit is narrower).
+SimulationPlan planSimulation(const QPUCircuit& circuit, int block_qubits = BLOCK_QUBITS);
+
+// Dense statevector. Bit q of an amplitude's index is the state of qubit q.
+// Gates run on AVX2 kernels when the factor kernels do (see
+// activeSimdLevel), otherwise on scalar ones, split across a thread pool by
+// cache block or by chunks of amplitude pairs.
+class StateVector {
+public:
+    int num_qubits;
+    AmplitudeBuffer amplitudes;
+
+    StateVector();
+
+    // Threads for gate application; 0 (the default) means all cores
+    void setThreads(size_t num_threads);
+    // |0...0> on num_qubits qubits; fails above MAX_SIMULATED_QUBITS
+    bool reset(int num_qubits);
+    // Apply the row-major 2x2 matrix m to target, only on amplitudes where
+    // control is 1 (control -1: everywhere)
+    void apply(int target, int control, const Amplitude m[4]);
+    // Gate semantics follow qelib1.inc, as in the QASM export. MEASURE
+    // leaves the state alone; sampling is done by simulateCircuit.
+    void applyGate(const QuantumGate& gate);
+    // Every op of a plan for this many qubits
+    void run(const SimulationPlan& plan);
+    double probability(uint64_t index) const { return std::norm(amplitudes[index]); }
+
+private:
+    size_t num_threads;
+    std::unique_ptr<ThreadPool> pool;
+
+    ThreadPool& threads();
+};
+
+// Measurement counts of a simulated circuit
+class SimulationResult {
+public:
+    std::vector<int> measured;  // Qubits sampled, in order of first MEASURE
+    size_t shots;
+    // (outcome, count), most frequent first; bit m of outcome is qubit measured[m]
+    std::vector<std::pair<uint64_t, size_t>> counts;
+
+    SimulationResult();
+    std::string bitstring(uint64_t outcome) const;  // measured[0] first
+    void print(size_t max_outcomes = 20) const;
+};
+
+// Run circuit from |0...0> on num_threads threads (0: all cores) and sample
+// its measured qubits shots times (all qubits if it measures none).
+// Measurements must be terminal: no gate may touch a qubit after it is
+// measured. Reports on std::cerr and returns false for circuits that are too
+// wide or have gates on invalid qubits.
+bool simulateCircuit(const QPUCircuit& circuit, size_t shots, SimulationResult& result,
+                     size_t num_threads = 0, uint64_t seed = 1);
+
+// Time the simulation of circuit on 1, 2, 4, ... threads up to max_threads
+// (0: all cores) and print amplitude updates per second (gates times 2^n
+// amplitudes, so fused and blocked runs compare with the plain gate count)
+// and the speedup over one thread.
+bool benchmarkSimulation(const QPUCircuit& circuit, size_t max_threads);
+
+#endif // SIMULATOR_H
@@ -0,0 +1,149 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+static inline uint64_t packRange(uint64_t begin, uint64_t end) {
+    return (begin << 32) | end;
+}
+
+ThreadPool::ThreadPool(size_t num_threads)
+    : stopping(false), generation(0), active(0), job(nullptr), job_base(0), cancelled(false) {
+    if (num_threads == 0) {
+        num_threads = hardwareThreads();
+    }
+    ranges.reset(new WorkRange[num_threads]);
+    for (size_t i = 0; i < num_threads; i++) {
+        ranges[i].span.store(0);
+    }
+    for (size_t i = 1; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::hardwareThreads() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? count : 1;
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task) {
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; i++) {
+            task(i);
+        }
+        return;
+    }
+
+    const size_t window = (size_t)1 << 31;
+    for (size_t base = 0; base < count; base += window) {
+        runWindow(base, std::min(window, count - base), task);
+    }
+}
+
+void ThreadPool::runWindow(size_t base, size_t count, const std::function<void(size_t)>& task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &task;
+        job_base = base;
+        // Even shares up front; stealing evens out what they cost
+        size_t participants = size();
+        for (size_t k = 0; k < participants; k++) {
+            ranges[k].span.store(packRange(count * k / participants, count * (k + 1) / participants));
+        }
+        active = workers.size();
+        cancelled.store(false);
+        failure = nullptr;
+        generation++;
+    }
+    work_ready.notify_all();
+    runJob(0);
+
+    // Workers use task until they are done, so wait for them even if the
+    // loop failed, and only then pass the failure on
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return active == 0; });
+    job = nullptr;
+    if (failure) {
+        std::exception_ptr error = failure;
+        failure = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void ThreadPool::runJob(size_t slot) {
+    size_t i;
+    try {
+        while (!cancelled.load(std::memory_order_relaxed) && takeIndex(slot, i)) {
+            (*job)(job_base + i);
+        }
+    } catch (...) {
+        cancelled.store(true);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!failure) {
+            failure = std::current_exception();
+        }
+    }
+}
+
+bool ThreadPool::takeIndex(size_t slot, size_t& index) {
+    // Next index of our own share
+    std::atomic<uint64_t>& own = ranges[slot].span;
+    uint64_t span = own.load();
+    while ((span >> 32) < (span & 0xffffffffu)) {
+        uint64_t begin = span >> 32;
+        if (own.compare_exchange_weak(span, packRange(begin + 1, span & 0xffffffffu))) {
+            index = begin;
+            return true;
+        }
+    }
+
+    // Steal the back half of someone else's share: run its first index now
+    // and keep the rest as our own. Indices are handed out once per loop, so
+    // a share never returns to a value a stale CAS could match.
+    size_t participants = size();
+    for (size_t k = 1; k < participants; k++) {
+        std::atomic<uint64_t>& victim = ranges[(slot + k) % participants].span;
+        span = victim.load();
+        while ((span >> 32) < (span & 0xffffffffu)) {
+            uint64_t begin = span >> 32;
+            uint64_t end = span & 0xffffffffu;
+            uint64_t middle = end - (end - begin + 1) / 2;
+            if (victim.compare_exchange_weak(span, packRange(begin, middle))) {
+                own.store(packRange(middle + 1, end));
+                index = middle;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(size_t slot) {
+    size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        runJob(slot);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--active == 0) {
+                work_done.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <exception>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in every loop, so a pool of size 1 runs everything inline.
+//
+// Each participant starts a loop with a contiguous share of the indices and
+// works through it front to back; one that runs dry steals the back half of
+// another's remaining share, so uneven tasks balance out while neighbouring
+// indices mostly stay on one thread.
+class ThreadPool {
+public:
+    // num_threads counts the caller; 0 means one per hardware thread
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+
+    size_t size() const { return workers.size() + 1; }
+
+    // Run task(i) for every i in [0, count) and wait for all of them.
+    // If a task throws, indices not yet started are skipped, the loop still
+    // waits for every participant, and the first exception is rethrown here.
+    // Not reentrant: tasks must not call parallelFor on the same pool.
+    void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+    static size_t hardwareThreads();
+
+private:
+    // Remaining indices [begin, end) of one participant, packed as
+    // begin << 32 | end so owner and thieves update it with one CAS. Padded
+    // to a cache line so participants do not share one.
+    struct WorkRange {
+        std::atomic<uint64_t> span;
+        char padding[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    bool stopping;
+    size_t generation;  // Bumped for every loop so workers notice new work
+    size_t active;      // Workers still inside the current loop
+
+    const std::function<void(size_t)>* job;
+    size_t job_base;  // Loops over 2^32 indices run as consecutive windows
+    std::unique_ptr<WorkRange[]> ranges;  // One per participant, caller first
+    std::atomic<bool> cancelled;          // A task threw; hand out no more indices
+    std::exception_ptr failure;           // First exception of the loop (under mutex)
+
+    void workerLoop(size_t slot);
+    void runWindow(size_t base, size_t count, const std::function<void(size_t)>& task);
+    void runJob(size_t slot);
+    bool takeIndex(size_t slot, size_t& index);
+
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+};
+
+#endif // THREAD_POOL_H